@@ -253,6 +253,14 @@ public:
  * Call all notifiers (on_sample).
  */
 	void on_sample(short l, short r);
+/**
+ * Call all notifiers (on_samples).
+ *
+ * Parameter samples: The samples. Left and right channels are interleaved if stereo.
+ * Parameter count: Number of samples (sample pairs if stereo).
+ * Parameter stereo: If true, the samples are stereo, otherwise mono.
+ */
+	void on_samples(const int16_t* samples, size_t count, bool stereo);
 /**
  * Call all notifiers (on_rate_change)
  *
@@ -298,12 +306,27 @@ public:
 	template<bool X> bool render_video_hud(struct framebuffer::fb<X>& target, struct framebuffer::raw& source,
 		uint32_t hscl, uint32_t vscl, uint32_t lgap, uint32_t tgap, uint32_t rgap, uint32_t bgap,
 		std::function<void()> fn);
+/**
+ * Render Lua HUD on video, sharing the converted frame between dumpers if possible.
+ *
+ * If Lua draws nothing, the scale is 1x and there are no gaps, the frame is converted only once per on_frame()
+ * and the same read-only copy is returned to all dumpers. Otherwise renders to target like render_video_hud().
+ * The returned frame is only valid until the dumper returns from on_frame().
+ *
+ * Parameters are as in render_video_hud().
+ * Returns: The frame to dump, or NULL if frame should not be dumped.
+ */
+	const framebuffer::fb<false>* render_video_hud_shared(struct framebuffer::fb<false>& target,
+		struct framebuffer::raw& source, uint32_t hscl, uint32_t vscl, uint32_t lgap, uint32_t tgap,
+		uint32_t rgap, uint32_t bgap, std::function<void()> fn);
 /**
  * Calculate number of sound samples to drop due to dropped frame.
  */
 	uint64_t killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction);
 private:
 	void statuschange();
+	bool run_video_hud(struct framebuffer::queue& rq, struct framebuffer::raw& source, uint32_t hscl,
+		uint32_t vscl, uint32_t& lgap, uint32_t& tgap, uint32_t& rgap, uint32_t& bgap, std::function<void()> fn);
 	friend class dumper_base;
 	std::map<dumper_factory_base*, dumper_base*> dumpers;
 	std::set<notifier*> notifications;
@@ -314,6 +337,8 @@ private:
 	std::ostream* output;
 	threads::rlock lock;
 	lua_state& lua2;
+	framebuffer::fb<false> shared_frame;
+	bool shared_valid;
 };
 
 class dumper_base
@@ -330,6 +355,16 @@ public:
  * New sample available.
  */
 	virtual void on_sample(short l, short r) = 0;
+/**
+ * New block of samples available.
+ *
+ * The default implementation calls on_sample() for each sample.
+ *
+ * Parameter samples: The samples. Left and right channels are interleaved if stereo.
+ * Parameter count: Number of samples (sample pairs if stereo).
+ * Parameter stereo: If true, the samples are stereo, otherwise mono.
+ */
+	virtual void on_samples(const int16_t* samples, size_t count, bool stereo);
 /**
  * Sample rate is changing.
  */
@@ -342,6 +377,34 @@ public:
  * Dump is being forcibly ended.
  */
 	virtual void on_end() = 0;
+/**
+ * Consume one sample from the audio to drop due to dropped frames.
+ *
+ * Returns: True if the sample should be dropped, false if it should be dumped.
+ */
+	bool kill_sample() throw()
+	{
+		if(__builtin_expect(samples_killed, 0)) {
+			samples_killed--;
+			return true;
+		}
+		return false;
+	}
+/**
+ * Consume samples from the audio to drop due to dropped frames.
+ *
+ * Parameter count: Number of samples available.
+ * Returns: Number of samples at start of the block that should be dropped.
+ */
+	size_t kill_samples(size_t count) throw()
+	{
+		if(__builtin_expect(samples_killed, 0)) {
+			size_t killed = (samples_killed < count) ? samples_killed : count;
+			samples_killed -= killed;
+			return killed;
+		}
+		return 0;
+	}
 /**
  * Render Lua HUD on video. samples_killed is incremented if needed.
  *
@@ -367,6 +430,21 @@ public:
 			samples_killed += mdumper->killed_audio_length(fps_n, fps_d, akillfrac);
 		return r;
 	}
+/**
+ * Render Lua HUD on video, sharing the converted frame with other dumpers if possible.
+ *
+ * Parameters are as in render_video_hud().
+ * Returns: The frame to dump (valid until return from on_frame()), or NULL if frame should not be dumped.
+ */
+	const framebuffer::fb<false>* render_video_hud_shared(struct framebuffer::fb<false>& target,
+		struct framebuffer::raw& source, uint32_t fps_n, uint32_t fps_d, uint32_t hscl, uint32_t vscl,
+		uint32_t lgap, uint32_t tgap, uint32_t rgap, uint32_t bgap, std::function<void()> fn)
+	{
+		auto r = mdumper->render_video_hud_shared(target, source, hscl, vscl, lgap, tgap, rgap, bgap, fn);
+		if(!r)
+			samples_killed += mdumper->killed_audio_length(fps_n, fps_d, akillfrac);
+		return r;
+	}
 private:
 	friend class master_dumper;
 	uint64_t samples_killed;
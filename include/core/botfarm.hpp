@@ -0,0 +1,128 @@
+#ifndef _botfarm__hpp__included__
+#define _botfarm__hpp__included__
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Job or result passed between bot farm coordinator and worker.
+ */
+struct botfarm_message
+{
+/**
+ * Job id.
+ */
+	uint64_t id;
+/**
+ * Script-defined data (e.g. input sequence or score).
+ */
+	std::string data;
+/**
+ * Serialized rewind point (empty if none).
+ */
+	std::vector<char> state;
+/**
+ * Error message (results only, empty if the job was completed).
+ */
+	std::string error;
+};
+
+/**
+ * Coordinator side of bot farm: a set of headless worker processes that run jobs.
+ *
+ * Each worker runs one job at a time. Jobs are queued until a worker is free.
+ */
+class botfarm_coordinator
+{
+public:
+/**
+ * Start worker processes.
+ *
+ * Parameter workers: Number of worker processes.
+ * Parameter argv: Command line of worker (argv[0] is the program). Workers get jobs from fd 3 and send results
+ *	to fd 4.
+ * Parameter log: Prefix of worker log files, or empty to discard worker output.
+ * Throws std::runtime_error: Can't start workers.
+ */
+	botfarm_coordinator(unsigned workers, const std::vector<std::string>& argv, const std::string& log);
+/**
+ * Destructor. Terminates the workers.
+ */
+	~botfarm_coordinator() throw();
+/**
+ * Submit a job.
+ *
+ * Parameter data: Data for job.
+ * Parameter state: Serialized rewind point for job (may be empty).
+ * Returns: The job id.
+ */
+	uint64_t submit(const std::string& data, const std::vector<char>& state);
+/**
+ * Hand queued jobs to free workers and collect completed results.
+ *
+ * Parameter out: Completed results are appended here.
+ * Parameter timeout: Wait at most this many milliseconds for a result if none is available (0 => don't wait,
+ *	-1 => wait forever, as long as there are jobs pending).
+ */
+	void poll(std::list<botfarm_message>& out, int timeout);
+/**
+ * Get number of jobs submitted but not yet returned.
+ */
+	size_t pending() { return queue.size() + running; }
+/**
+ * Get number of live workers.
+ */
+	size_t workers() { return slots.size(); }
+private:
+	struct slot
+	{
+		int pid;
+		int to;
+		int from;
+		bool busy;
+		botfarm_message job;
+		std::vector<char> rbuf;
+	};
+	void dispatch();
+	void shutdown() throw();
+	bool read_results(slot& s, std::list<botfarm_message>& out);
+	void kill_slot(size_t i, std::list<botfarm_message>& out, const std::string& why);
+	botfarm_coordinator(const botfarm_coordinator&);
+	botfarm_coordinator& operator=(const botfarm_coordinator&);
+	std::vector<slot> slots;
+	std::list<botfarm_message> queue;
+	size_t running;
+	uint64_t next_id;
+};
+
+/**
+ * Set up the worker side of bot farm.
+ *
+ * Parameter in: File descriptor jobs are read from.
+ * Parameter out: File descriptor results are written to.
+ */
+void botfarm_worker_init(int in, int out);
+/**
+ * Is this process a bot farm worker?
+ */
+bool botfarm_is_worker();
+/**
+ * Wait for next job (worker only).
+ *
+ * Parameter job: The job is written here.
+ * Returns: True if job was received, false if the coordinator has gone away.
+ * Throws std::runtime_error: Not a worker, or error reading the job.
+ */
+bool botfarm_worker_get_job(botfarm_message& job);
+/**
+ * Send a result (worker only).
+ *
+ * Parameter result: The result to send.
+ * Throws std::runtime_error: Not a worker, or error writing the result.
+ */
+void botfarm_worker_put_result(const botfarm_message& result);
+
+#endif
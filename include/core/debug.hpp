@@ -4,6 +4,7 @@
 #include <functional>
 #include <fstream>
 #include <cstdint>
+#include <vector>
 #include "library/command.hpp"
 #include "library/dispatch.hpp"
 
@@ -148,8 +149,9 @@ public:
  * Request a break.
  */
 	void request_break();
-	//These are public only for some debugging stuff.
-	typedef std::list<callback_base*> cb_list;
+	//These are public only for some debugging stuff. Entries removed while callbacks are running are NULL until
+	//the outermost callback returns.
+	typedef std::vector<callback_base*> cb_list;
 	std::map<uint64_t, cb_list> read_cb;
 	std::map<uint64_t, cb_list> write_cb;
 	std::map<uint64_t, cb_list> exec_cb;
@@ -159,7 +161,45 @@ private:
 	void do_showhooks();
 	void do_genevent(const std::string& a);
 	void do_tracecmd(const std::string& a);
-	cb_list dummy_cb;  //Always empty.
+	void run_callbacks(cb_list* lst1, cb_list* lst2, const params& p, bool enable1 = true);
+	void sweep_callbacks();
+/**
+ * Open-addressed index from address to callback list, so dispatch doesn't need to walk the map.
+ */
+	struct hook_index
+	{
+		hook_index();
+		cb_list* find(uint64_t addr) const throw()
+		{
+			if(!used)
+				return NULL;
+			size_t mask = slots.size() - 1;
+			for(size_t i = hash(addr) & mask;; i = (i + 1) & mask) {
+				if(!slots[i].list || slots[i].addr == addr)
+					return slots[i].list;
+			}
+		}
+		void set(uint64_t addr, cb_list* list);
+		void erase(uint64_t addr) throw();
+		void clear() throw();
+	private:
+		struct slot
+		{
+			uint64_t addr;
+			cb_list* list;		//NULL if slot is free.
+		};
+		static size_t hash(uint64_t addr) throw()
+		{
+			return (addr * 0x9E3779B97F4A7C15ULL) >> 32;
+		}
+		std::vector<slot> slots;
+		size_t used;
+	};
+	hook_index read_idx;
+	hook_index write_idx;
+	hook_index exec_idx;
+	unsigned dispatch_depth = 0;
+	bool sweep_needed = false;
 	uint64_t xmask = 1;
 	std::function<void()> tracelog_change_cb;
 	emulator_dispatch& edispatch;
@@ -173,17 +213,21 @@ private:
 	command::_fnptr<const std::string&> genevent;
 	command::_fnptr<const std::string&> tracecmd;
 
+	struct tracelog_writer;
 	struct tracelog_file : public callback_base
 	{
-		std::ofstream stream;
 		std::string full_filename;
 		unsigned refcnt;
-		tracelog_file(debug_context& parent);
+		tracelog_file(debug_context& parent, const std::string& filename);
 		~tracelog_file();
 		void callback(const params& p);
 		void killed(uint64_t addr, etype type);
+		void flush();
 	private:
 		debug_context& parent;
+		tracelog_writer* writer;
+		std::vector<char> buffer;
+		bool failed;
 	};
 	std::map<uint64_t, tracelog_file*> trace_outputs;
 
@@ -198,6 +242,15 @@ private:
 		default: throw std::runtime_error("Invalid debug callback type");
 		}
 	}
+	hook_index* get_index(etype type)
+	{
+		switch(type) {
+		case DEBUG_READ: return &read_idx;
+		case DEBUG_WRITE: return &write_idx;
+		case DEBUG_EXEC: return &exec_idx;
+		default: return NULL;
+		}
+	}
 };
 
 #endif
@@ -40,6 +40,10 @@ void do_load_rewind();
 void do_load_state(struct moviefile& _movie, int lmode, bool& used);
 bool do_load_state(const std::string& filename, int lmode);
 std::string translate_name_mprefix(std::string original, int& binary, int save);
+/**
+ * Wait for savestates being written in background to complete. Must be called from emulation thread.
+ */
+void wait_pending_saves();
 
 extern std::string last_save;
 
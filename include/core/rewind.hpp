@@ -0,0 +1,33 @@
+#ifndef _rewind__hpp__included__
+#define _rewind__hpp__included__
+
+/**
+ * Is capture of rewind point due this frame?
+ *
+ * Returns: True if rewind_capture() should be called at next save point.
+ */
+bool rewind_capture_due();
+/**
+ * Capture a rewind point. Must be called at save point.
+ *
+ * Throws std::bad_alloc: Not enough memory.
+ */
+void rewind_capture();
+/**
+ * Is rewind being requested (rewind key held)?
+ */
+bool rewind_requested();
+/**
+ * Restore the latest rewind point.
+ *
+ * Returns: True if rewind point was restored, false if there are no rewind points left.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Restoring state failed.
+ */
+bool rewind_restore();
+/**
+ * Discard all rewind points (e.g. due to loadstate).
+ */
+void rewind_clear();
+
+#endif
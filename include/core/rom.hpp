@@ -47,6 +47,28 @@ struct loaded_rom
  * throws std::bad_alloc: Not enough memory.
  */
 	std::vector<char> save_core_state(bool nochecksum = false);
+/**
+ * Saves core state into existing buffer, reusing its memory. WARNING: This takes emulated time.
+ *
+ * parameter out: The buffer to save the state to. Old contents are overwritten.
+ * parameter nochecksum: If true, don't append checksum.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	void save_core_state(std::vector<char>& out, bool nochecksum = false);
+/**
+ * Append checksum to core state saved without one.
+ *
+ * Note: Does not touch the core, so can be called from any thread.
+ *
+ * parameter state: The state to append the checksum to.
+ * parameter fast: If true, use the fast checksum instead of SHA-256.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	static void append_core_state_checksum(std::vector<char>& state, bool fast = false);
+/**
+ * Is the fast checksum selected for savestates?
+ */
+	bool fast_core_state_checksum();
 
 /**
  * Loads core state from buffer.
@@ -123,6 +145,7 @@ struct loaded_rom
 		return rtype().execute_action(id, p);
 	}
 	std::pair<unsigned, unsigned> lightgun_scale() { return rtype().lightgun_scale(); }
+	bool set_render(bool enable) { return rtype().set_render(enable); }
 	const interface_device_reg* get_registers() { return rtype().get_registers(); }
 	bool get_pflag() { return rtype().get_pflag(); }
 	void set_pflag(bool pflag) { rtype().set_pflag(pflag); }
@@ -206,6 +229,8 @@ struct romload_request
 bool load_null_rom();
 bool _load_new_rom(const romload_request& req);
 bool reload_active_rom();
+//Command line options that make construct_rom() load the same ROM as is currently loaded.
+std::vector<std::string> active_rom_arguments();
 regex_results get_argument(const std::vector<std::string>& cmdline, const std::string& regexp);
 std::string get_requested_core(const std::vector<std::string>& cmdline);
 void try_guess_roms(rom_request& req);
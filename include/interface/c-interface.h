@@ -112,8 +112,9 @@ extern "C" {
 #define LSNES_CORE_CAP1_LIGHTGUN	0x00020000U
 //Core supports fast reinit (By supporting LSNES_CORE_REINIT).
 #define LSNES_CORE_CAP1_REINIT		0x00040000U
+//Core supports skipping video rendering (By supporting LSNES_CORE_SET_RENDER).
+#define LSNES_CORE_CAP1_RENDERSKIP	0x00080000U
 //Reserved capabilities.
-#define LSNES_CORE_CAP1_RESERVED19	0x00080000U
 #define LSNES_CORE_CAP1_RESERVED20	0x00100000U
 #define LSNES_CORE_CAP1_RESERVED21	0x00200000U
 #define LSNES_CORE_CAP1_RESERVED22	0x00400000U
@@ -850,6 +851,19 @@ struct lsnes_core_reinit
 {
 };
 
+//Request 35: Enable/Disable video rendering.
+//Item id: Core ID.
+//Default action: Do nothing (always render).
+//Signals whether the frames emulated from now on will be shown. While rendering is disabled, the core may skip
+//generating video, but still has to call submit_frame once per frame (the contents of the framebuffer are then
+//unspecified). Emulation results must not depend on this setting.
+#define LSNES_CORE_SET_RENDER 35
+struct lsnes_core_set_render
+{
+	//Input: If nonzero, render frames, else rendering may be skipped.
+	int enable;
+};
+
 
 #ifdef LSNES_BUILD_AS_BUILTIN_CORE
 void lsnes_register_builtin_core(lsnes_core_func_t fn);
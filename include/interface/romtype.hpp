@@ -357,6 +357,7 @@ struct core_core
 	const interface_device_reg* get_registers();
 	int reset_action(bool hard);
 	std::pair<unsigned, unsigned> lightgun_scale();
+	bool set_render(bool enable);
 	void set_debug_flags(uint64_t addr, unsigned flags_set, unsigned flags_clear);
 	void set_cheat(uint64_t addr, uint64_t value, bool set);
 	std::vector<std::string> get_trace_cpus();
@@ -402,6 +403,9 @@ protected:
 	virtual void c_load_sram(std::map<std::string, std::vector<char>>& sram) = 0;
 /**
  * Serialize the system state.
+ *
+ * The buffer may be reused from earlier saves and has room reserved for the state, so cores should overwrite
+ * it (e.g. with assign() or resize()) rather than build a new vector and copy it.
  */
 	virtual void c_serialize(std::vector<char>& out) = 0;
 /**
@@ -512,6 +516,15 @@ protected:
  * Get lightgun scale (only cores that have lightguns need to define this).
  */
 	virtual std::pair<unsigned, unsigned> c_lightgun_scale();
+/**
+ * Enable/Disable video rendering for following frames (only cores that can skip rendering need to define this).
+ *
+ * While disabled, the core may skip generating video, but still outputs one frame per emulated frame (with
+ * unspecified contents). Emulation results must not depend on this setting.
+ *
+ * Returns: True if the core honors the setting, false if it always renders.
+ */
+	virtual bool c_set_render(bool enable);
 /**
  * Set/Clear debug callback flags for address.
  *
@@ -544,6 +557,7 @@ private:
 	bool hidden;
 	std::map<std::string, interface_action> actions;
 	threads::lock actions_lock;
+	size_t last_state_size;
 };
 
 struct core_type
@@ -612,6 +626,7 @@ public:
 	const interface_device_reg* get_registers() { return core->get_registers(); }
 	int reset_action(bool hard) { return core->reset_action(hard); }
 	std::pair<unsigned, unsigned> lightgun_scale() { return core->lightgun_scale(); }
+	bool set_render(bool enable) { return core->set_render(enable); }
 	void set_debug_flags(uint64_t addr, unsigned flags_set, unsigned flags_clear)
 	{
 		return core->set_debug_flags(addr, flags_set, flags_clear);
@@ -7,4 +7,10 @@
 #endif
 #endif
 
+//SSE/AVX intrinsics can be used inside #pragma GCC target regions (needs GCC 4.9+).
+#if defined(ARCH_IS_I386) && !defined(__clang__) && defined(__GNUC__) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define ARCH_HAS_I386_INTRINSICS
+#endif
+
 #endif
@@ -0,0 +1,31 @@
+#ifndef _library__cpu_features__hpp__included__
+#define _library__cpu_features__hpp__included__
+
+/**
+ * Runtime detection of optional CPU instruction set extensions. All functions return false on non-x86 CPUs.
+ */
+namespace cpu_features
+{
+/**
+ * Is SSE2 available?
+ */
+bool sse2() throw();
+/**
+ * Is SSSE3 available?
+ */
+bool ssse3() throw();
+/**
+ * Is SSE4.1 available?
+ */
+bool sse41() throw();
+/**
+ * Is AVX2 available (including OS support for saving YMM state)?
+ */
+bool avx2() throw();
+/**
+ * Are SHA extensions available?
+ */
+bool sha() throw();
+}
+
+#endif
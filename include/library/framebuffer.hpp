@@ -610,6 +610,8 @@ private:
 
 #define RENDER_PAGE_SIZE 65500
 
+template<class T> struct batch;
+
 /**
  * Queue of render operations.
  */
@@ -637,10 +639,31 @@ struct queue
 
 /**
  * Call object constructor on internal memory.
+ *
+ * Returns: The new object.
+ */
+	template<class T, typename... U> T* create_add(U... args)
+	{
+		//The node and the object share one allocation.
+		char* mem = reinterpret_cast<char*>(alloc(node_size + sizeof(T)));
+		T* obj = new(mem + node_size) T(args...);
+		add(reinterpret_cast<struct node*>(mem), *obj);
+		return obj;
+	}
+/**
+ * Add item to batch at end of the queue, starting new batch if the last object is not batch of the same type.
+ * Consecutive similar items (e.g. pixels) this way become one object.
+ *
+ * Parameter item: The item to add.
  */
-	template<class T, typename... U> void create_add(U... args)
+	template<class T> void batch_add(const T& item)
 	{
-		add(*new(alloc(sizeof(T))) T(args...));
+		batch<T>* b = NULL;
+		if(queue_tail && !queue_tail->killed)
+			b = dynamic_cast<batch<T>*>(queue_tail->obj);
+		if(!b)
+			b = create_add<batch<T>>();
+		b->add(*this, item);
 	}
 /**
  * Copy objects from another render queue.
@@ -666,6 +689,10 @@ struct queue
 		}
 		return c;
 	}
+/**
+ * Is the queue empty?
+ */
+	bool empty() const throw() { return (queue_head == NULL); }
 /**
  * Constructor.
  */
@@ -675,8 +702,9 @@ struct queue
  */
 	~queue() throw();
 private:
-	void add(struct object& obj);
 	struct node { struct object* obj; struct node* next; bool killed; };
+	static const size_t node_size = (sizeof(struct node) + 15) / 16 * 16;
+	void add(struct node* n, struct object& obj);
 	struct page {
 		char content[RENDER_PAGE_SIZE];
 		page() { memtracker::singleton()(render_page_id, RENDER_PAGE_SIZE + 36); }
@@ -684,13 +712,78 @@ private:
 	};
 	struct node* queue_head;
 	struct node* queue_tail;
-	size_t memory_allocated;
 	size_t pages;
+	char* page_free;		//Free space in current page.
+	size_t page_left;
 	threads::lock display_mutex; //Synchronize display and kill.
 	std::map<size_t, page> memory;
 	memtracker::autorelease tracker;
 };
 
+/**
+ * Batch of similar items in render queue, drawn as one object (see queue::batch_add).
+ *
+ * T is the item type. It must be copyable, not need destruction, and have member
+ * template<bool X> void draw(struct fb<X>& scr) throw() that draws it.
+ */
+template<class T> struct batch : public object
+{
+	batch() throw() { head = tail = NULL; }
+	~batch() throw() {}
+/**
+ * Add item. The memory comes from the queue the batch is in.
+ */
+	void add(queue& q, const T& item)
+	{
+		if(!tail || tail->count == tail->size) {
+			//Chunks grow, so both few and many items waste little memory.
+			size_t size = tail ? 2 * tail->size : 4;
+			if(size > max_chunk)
+				size = max_chunk;
+			chunk* c = reinterpret_cast<chunk*>(q.alloc(sizeof(chunk) + size * sizeof(T)));
+			c->next = NULL;
+			c->count = 0;
+			c->size = size;
+			if(tail)
+				tail = tail->next = c;
+			else
+				head = tail = c;
+		}
+		new(tail->items() + tail->count) T(item);
+		tail->count++;
+	}
+	template<bool X> void op(struct fb<X>& scr) throw()
+	{
+		for(chunk* c = head; c; c = c->next) {
+			T* items = c->items();
+			for(size_t i = 0; i < c->count; i++)
+				items[i].draw(scr);
+		}
+	}
+	void operator()(struct fb<true>& scr) throw() { op(scr); }
+	void operator()(struct fb<false>& scr) throw() { op(scr); }
+	void clone(queue& q) const
+	{
+		for(chunk* c = head; c; c = c->next) {
+			T* items = c->items();
+			for(size_t i = 0; i < c->count; i++)
+				q.batch_add(items[i]);
+		}
+	}
+private:
+	struct chunk
+	{
+		chunk* next;
+		size_t count;
+		size_t size;
+		uint64_t align;		//Items may have 64-bit members.
+		T* items() { return reinterpret_cast<T*>(this + 1); }
+	};
+	static const size_t max_chunk = (16384 / sizeof(T) > 0) ? 16384 / sizeof(T) : 1;
+	chunk* head;
+	chunk* tail;
+};
+
 /**
  * Drop every fourth byte of specified buffer.
  *
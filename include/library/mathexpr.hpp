@@ -6,6 +6,7 @@
 #include <stdexcept>
 #include "gc.hpp"
 #include "mathexpr-error.hpp"
+#include <map>
 #include <set>
 
 namespace mathexpr
@@ -43,12 +44,26 @@ struct operinfo
 	operinfo(std::string funcname);
 	operinfo(std::string opername, unsigned _operands, int _percedence, bool _rtl = false);
 	virtual ~operinfo();
-	virtual void evaluate(value target, std::vector<std::function<value()>> promises) = 0;
+	virtual void evaluate(value target, const std::vector<std::function<value()>>& promises) = 0;
+	//If true, result only depends on operands, so the operation can be evaluated at parse time if all operands
+	//are constant. Default is false.
+	virtual bool is_pure();
+	//Key for sharing common subexpressions. The same key applied to same operands must give the same value
+	//until the expressions are reset. Empty (the default) means the operation is never shared.
+	virtual std::string share_key();
+	//If true, evaluate_strict() can be used instead of evaluate(). The operation must need every operand and not
+	//handle errors from them, so the operands can be evaluated in advance. Default is false.
+	virtual bool is_strict();
+	//Evaluate from already evaluated operands. Only called if is_strict() is true.
+	virtual void evaluate_strict(value target, void* const* operands, size_t count);
 	const std::string fnname;
 	const bool is_operator;
 	const unsigned  operands; 		//Only for operators (max 2 operands).
 	const int precedence;			//Higher binds more tightly.
 	const bool rtl;			//If true, Right-to-left associvity.
+protected:
+	//Key unique to this operation object.
+	std::string identity_key();
 };
 
 struct typeinfo
@@ -84,42 +99,62 @@ struct typeinfo
 
 template<class T> struct operinfo_wrapper : public operinfo
 {
-	operinfo_wrapper(std::string funcname, T (*_fn)(std::vector<std::function<T&()>> promises))
-		: operinfo(funcname), fn(_fn)
+	operinfo_wrapper(std::string funcname, T (*_fn)(const std::vector<std::function<T&()>>& promises),
+		T (*_sfn)(void* const* operands, size_t count) = NULL)
+		: operinfo(funcname), fn(_fn), sfn(_sfn)
 	{
 	}
 	operinfo_wrapper(std::string opername, unsigned _operands, int _percedence, bool _rtl,
-		T (*_fn)(std::vector<std::function<T&()>> promises))
-		: operinfo(opername, _operands, _percedence, _rtl), fn(_fn)
+		T (*_fn)(const std::vector<std::function<T&()>>& promises),
+		T (*_sfn)(void* const* operands, size_t count) = NULL)
+		: operinfo(opername, _operands, _percedence, _rtl), fn(_fn), sfn(_sfn)
 	{
 	}
 	~operinfo_wrapper()
 	{
 	}
-	void evaluate(value target, std::vector<std::function<value()>> promises)
+	void evaluate(value target, const std::vector<std::function<value()>>& promises)
 	{
+		//Only capture pointer, so the promises fit into std::function without allocating.
 		std::vector<std::function<T&()>> _promises;
-		for(auto i : promises) {
-			std::function<value()> f = i;
-			_promises.push_back([f, this]() -> T& {
-				auto r = f();
-				return *(T*)r._value;
-			});
+		_promises.reserve(promises.size());
+		for(auto& i : promises) {
+			const std::function<value()>* f = &i;
+			_promises.push_back([f]() -> T& { return *(T*)(*f)()._value; });
 		}
 		*(T*)(target._value) = fn(_promises);
 	}
+	bool is_pure()
+	{
+		return true;
+	}
+	std::string share_key()
+	{
+		return identity_key();
+	}
+	bool is_strict()
+	{
+		return (sfn != NULL);
+	}
+	void evaluate_strict(value target, void* const* operands, size_t count)
+	{
+		*(T*)(target._value) = sfn(operands, count);
+	}
 private:
-	T (*fn)(std::vector<std::function<T&()>> promises);
+	T (*fn)(const std::vector<std::function<T&()>>& promises);
+	T (*sfn)(void* const* operands, size_t count);
 };
 
 template<class T> struct opfun_info
 {
 	std::string name;
-	T (*_fn)(std::vector<std::function<T&()>> promises);
+	T (*_fn)(const std::vector<std::function<T&()>>& promises);
 	bool is_operator;
 	unsigned operands;
 	int precedence;
 	bool rtl;
+	//Same operation from already evaluated operands, if the operation always needs all of them (or NULL).
+	T (*_sfn)(void* const* operands, size_t count);
 };
 
 template<class T> struct operinfo_set
@@ -129,9 +164,9 @@ template<class T> struct operinfo_set
 		for(auto i : list) {
 			if(i.is_operator)
 				set.insert(new operinfo_wrapper<T>(i.name, i.operands, i.precedence,
-					i.rtl, i._fn));
+					i.rtl, i._fn, i._sfn));
 			else
-				set.insert(new operinfo_wrapper<T>(i.name, i._fn));
+				set.insert(new operinfo_wrapper<T>(i.name, i._fn, i._sfn));
 		}
 	}
 	~operinfo_set()
@@ -222,6 +257,20 @@ template<class T> struct typeinfo_wrapper : public typeinfo
 	}
 };
 
+//Pool for sharing common subexpressions between expressions parsed using the same pool. Only holds weak
+//references, so it must not be kept across garbage collection.
+class expr_pool
+{
+public:
+	//Fold constants in expression and replace its subexpressions with equivalent ones from pool.
+	GC::pointer<mathexpr> intern(GC::pointer<mathexpr> expr);
+private:
+	mathexpr* intern(mathexpr* expr);
+	std::string key_of(mathexpr* expr);
+	std::map<std::string, mathexpr*> nodes;
+	std::map<mathexpr*, std::string> keys;
+};
+
 class mathexpr : public GC::item
 {
 public:
@@ -259,13 +308,30 @@ public:
 	typeinfo& get_type() { return type; }
 	//Reset.
 	void reset();
-	//Parse an expression.
+	//Parse an expression. If pool is given, common subexpressions are shared with other expressions in pool.
 	static GC::pointer<mathexpr> parse(typeinfo& _type, const std::string& expr,
-		std::function<GC::pointer<mathexpr>(const std::string&)> vars);
+		std::function<GC::pointer<mathexpr>(const std::string&)> vars, expr_pool* pool = NULL);
 protected:
 	void trace();
 private:
+	friend class expr_pool;
+	//Step of evaluation program.
+	struct step
+	{
+		mathexpr* node;		//Node to evaluate.
+		size_t parent;		//Step of the parent node (program size for the node owning the program).
+		bool leaf;		//Evaluated by itself, not from operands evaluated by earlier steps.
+	};
+	value evaluate_node(bool operands_ready);
 	void mark_error_and_throw(error::errorcode _errcode, const std::string& _error);
+	void make_promises();
+	bool fold();
+	bool is_strict_operation();
+	void compile();
+	void flatten(mathexpr* _parent, std::vector<step>& out, std::vector<mathexpr*>& parents,
+		std::map<mathexpr*, size_t>& index);
+	void run_program();
+	void fail_ancestors(size_t i, error::errorcode _errcode, const std::string& _xerror);
 	eval_state state;
 	typeinfo& type;				//Type of value.
 	void* _value;				//Value if state is EVALUATED or FIXED.
@@ -273,6 +339,11 @@ private:
 	error::errorcode errcode;		//Error code if state is FAILED.
 	std::string _error;			//Error message if state is FAILED.
 	std::vector<mathexpr*> arguments;
+	std::vector<std::function<value()>> promises;	//Promises for arguments, passed to fn.
+	std::vector<void*> operand_values;	//Values of arguments, passed to fn if strict.
+	std::vector<step> program;		//Strict operations below this one in evaluation order.
+	bool compiled;				//Program is up to date.
+	std::string fixed_key;			//Pool key if state is FIXED.
 	mutable bool owns_operator;
 };
 }
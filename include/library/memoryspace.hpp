@@ -4,6 +4,7 @@
 #include <string>
 #include <list>
 #include <vector>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include "threads.hpp"
@@ -108,6 +109,14 @@ public:
  */
 		~region_direct() throw();
 	};
+/**
+ * Create a new memory space with no regions.
+ */
+	memory_space();
+/**
+ * Destructor. Does not free the regions.
+ */
+	~memory_space();
 /**
  * Get system endianess.
  */
@@ -127,6 +136,8 @@ public:
 /**
  * Lookup region covering address.
  *
+ * Does not lock. Repeated lookups within the same region from the same thread are served from per-thread cache.
+ *
  * Parameter address: The address to look up.
  * Returns: The region/offset pair, or NULL/0 if that address is unmapped.
  */
@@ -148,13 +159,13 @@ public:
 /**
  * Get number of regions.
  */
-	size_t get_region_count() { return u_regions.size(); }
+	size_t get_region_count();
 /**
  * Get linear RAM size.
  *
  * Returns: The linear RAM size in bytes.
  */
-	uint64_t get_linear_size() { return linear_size; }
+	uint64_t get_linear_size();
 /**
  * Get list of all regions in memory space.
  */
@@ -249,11 +260,33 @@ public:
  */
 	std::string address_to_textual(uint64_t addr);
 private:
+	memory_space(const memory_space&);
+	memory_space& operator=(const memory_space&);
+	//Immutable region table. Replaced as whole by set_regions().
+	struct region_table
+	{
+		std::vector<region*> regions;
+		std::vector<region*> lregions;
+		std::vector<uint64_t> linear_bases;
+		uint64_t linear_size;
+	};
+	//Keeps the current table alive while in scope.
+	class table_ref
+	{
+	public:
+		table_ref(memory_space& m) : readers(m.readers) { readers++; t = m.table.load(); }
+		~table_ref() { readers--; }
+		const region_table* operator->() const { return t; }
+	private:
+		table_ref(const table_ref&);
+		table_ref& operator=(const table_ref&);
+		std::atomic<unsigned>& readers;
+		const region_table* t;
+	};
 	threads::lock mlock;
-	std::vector<region*> u_regions;
-	std::vector<region*> u_lregions;
-	std::vector<uint64_t> linear_bases;
-	uint64_t linear_size;
+	std::atomic<region_table*> table;
+	std::atomic<unsigned> readers;
+	std::atomic<uint64_t> generation;
 	static int _get_system_endian();
 	static int sysendian;
 };
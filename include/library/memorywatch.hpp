@@ -29,7 +29,11 @@ struct memread_oper : public mathexpr::operinfo
  *
  * Note: The first promise is for the address.
  */
-	void evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises);
+	void evaluate(mathexpr::value target, const std::vector<std::function<mathexpr::value()>>& promises);
+/**
+ * Key for sharing reads. Reads with the same parameters give the same value until the expressions are reset.
+ */
+	std::string share_key();
 	//Fields.
 	unsigned bytes;		//Number of bytes to read.
 	bool signed_flag;	//Is signed?
@@ -198,8 +198,9 @@ public:
  *
  * parameter frame: The frame number.
  * returns: Number of subframes (0 if outside movie).
+ * throws std::bad_alloc: Not enough memory.
  */
-	uint64_t frame_subframes(uint64_t frame) throw();
+	uint64_t frame_subframes(uint64_t frame);
 /**
  * Read controls from specified subframe of specified frame.
  *
@@ -207,16 +208,20 @@ public:
  * parameter subframe: Subframe within frame (first is 0).
  * returns: The controls for subframe. If subframe is too great, reads last present subframe. If frame is outside
  *	movie, reads all released.
+ * throws std::bad_alloc: Not enough memory.
  */
-	portctrl::frame read_subframe(uint64_t frame, uint64_t subframe) throw();
+	portctrl::frame read_subframe(uint64_t frame, uint64_t subframe);
 /**
  * Fast save.
  */
 	void fast_save(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters);
 /**
  * Fast load.
+ *
+ * parameter ro: The new state of readonly flag (if false, the movie is truncated).
  */
-	void fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters);
+	void fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& counters,
+		bool ro = false);
 /**
  * Poll flag handling.
  */
@@ -319,6 +324,10 @@ private:
 	uint64_t cached_subframe;
 	//Count present subframes in frame starting from first_subframe (returns 0 if out of movie).
 	uint32_t count_changes(uint64_t first_subframe) throw();
+	//Find first subframe of frame (movie_data.size() if out of movie), using the sync index of the movie data.
+	uint64_t first_subframe(uint64_t frame);
+	//Find first subframe of frame and cache it. Short forward seeks walk from the cached frame.
+	uint64_t seek_frame(uint64_t frame);
 	//Tracker.
 	memtracker::autorelease tracker;
 };
@@ -16,6 +16,7 @@
 #include <map>
 #include <list>
 #include <set>
+#include <atomic>
 #include "json.hpp"
 #include "threads.hpp"
 #include "memtracker.hpp"
@@ -1056,14 +1057,14 @@ public:
  */
 	~frame_vector() throw();
 /**
- * Copy controller frame vector.
+ * Copy controller frame vector. The pages are shared with the original until either is written to.
  *
  * Parameter obj: The object to copy.
  * Throws std::bad_alloc: Not enough memory.
  */
 	frame_vector(const frame_vector& vector);
 /**
- * Assign controller frame vector.
+ * Assign controller frame vector. The pages are shared with the original until either is written to.
  *
  * Parameter obj: The object to copy.
  * Returns: Reference to this.
@@ -1098,7 +1099,7 @@ public:
 		return *types;
 	}
 /**
- * Access specified subframe.
+ * Access specified subframe. If the page containing the subframe is shared, it is unshared first.
  *
  * Parameter x: The frame number.
  * Returns: The controller frame.
@@ -1111,11 +1112,20 @@ public:
 		if(x >= frames)
 			throw std::runtime_error("frame_vector::operator[]: Illegal index");
 		if(page != cache_page_num) {
-			cache_page = &pages[page];
+			cache_page = &pages[page].write();
 			cache_page_num = page;
 		}
 		return frame(cache_page->content + pageoffset, *types, this);
 	}
+/**
+ * Read specified subframe. Unlike operator[], this does not unshare the page containing the subframe, so the
+ * returned frame must not be modified.
+ *
+ * Parameter x: The frame number.
+ * Returns: The controller frame.
+ * Throws std::runtime_error: Invalid frame index.
+ */
+	frame read_frame(size_t x) const;
 /**
  * Append a subframe.
  *
@@ -1200,13 +1210,19 @@ public:
  */
 	size_t get_frames_per_page() const { return frames_per_page; }
 /**
- * Get content of given page.
+ * Get content of given page for writing. If the page is shared with another vector, it is unshared first.
  */
-	unsigned char* get_page_buffer(size_t page) { return pages[page].content; }
+	unsigned char* get_page_buffer(size_t page)
+	{
+		auto& pg = pages[page].write();
+		pg.syncs_valid = false;
+		invalidate_sync_index(page);
+		return pg.content;
+	}
 /**
- * Get content of given page.
+ * Get content of given page for reading.
  */
-	const unsigned char* get_page_buffer(size_t page) const { return pages.find(page)->second.content; }
+	const unsigned char* get_page_buffer(size_t page) const { return read_page(page); }
 /**
  * Get binary save size.
  *
@@ -1249,12 +1265,9 @@ public:
  * Notify sync flag polarity change.
  *
  * Parameter polarity: 1 if positive edge, -1 if negative edge. 0 is ignored.
+ * Parameter frame: The memory of the frame that changed.
  */
-	void notify_sync_change(short polarity) {
-		uint64_t old_frame_count = real_frame_count;
-		real_frame_count = real_frame_count + polarity;
-		if(!freeze_count) call_framecount_notification(old_frame_count);
-	}
+	void notify_sync_change(short polarity, const unsigned char* frame);
 /**
  * Set where to deliver frame count change notifications to.
  *
@@ -1327,24 +1340,83 @@ private:
 		page() {
 			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
 			memset(content, 0, CONTROLLER_PAGE_SIZE);
+			refs = 1;
+			syncs = 0;
+			syncs_valid = true;
+		}
+		page(const page& p) {
+			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
+			memcpy(content, p.content, CONTROLLER_PAGE_SIZE);
+			refs = 1;
+			syncs = p.syncs;
+			syncs_valid = p.syncs_valid;
 		}
 		~page() { memtracker::singleton()(movie_page_id, -CONTROLLER_PAGE_SIZE - 36); }
+		std::atomic<unsigned> refs;
+		//Number of subframes in page with sync flag set. Derived from content, so it can be updated on shared
+		//page.
+		mutable uint32_t syncs;
+		mutable bool syncs_valid;
 		unsigned char content[CONTROLLER_PAGE_SIZE];
+	private:
+		page& operator=(const page& p);
+	};
+/**
+ * Reference to page shared between frame vectors. Copying the reference shares the page, which is cloned on
+ * first write if it is still shared.
+ */
+	class page_ref
+	{
+	public:
+		page_ref() : p(new page) {}
+		page_ref(const page_ref& r) : p(r.p) { p->refs++; }
+		page_ref& operator=(const page_ref& r)
+		{
+			r.p->refs++;
+			release();
+			p = r.p;
+			return *this;
+		}
+		~page_ref() { release(); }
+		const page& read() const { return *p; }
+		page& write()
+		{
+			if(p->refs > 1) {
+				page* n = new page(*p);
+				release();
+				p = n;
+			}
+			return *p;
+		}
+	private:
+		void release() { if(!--p->refs) delete p; }
+		page* p;
 	};
 	size_t frames_per_page;
 	size_t frame_size;
 	size_t frames;
 	const type_set* types;
-	size_t cache_page_num;
-	page* cache_page;
-	std::map<size_t, page> pages;
+	mutable size_t cache_page_num;
+	mutable page* cache_page;
+	std::map<size_t, page_ref> pages;
+	//Number of sync subframes before each page (and total in last element). Elements past
+	//sync_index_valid are stale.
+	std::vector<uint64_t> sync_index;
+	size_t sync_index_valid;
 	uint64_t real_frame_count;
 	uint64_t frame_count_at_freeze;
 	size_t freeze_count;
 	std::set<fchange_listener*> on_framecount_change;
 	size_t walk_helper(size_t frame, bool sflag) throw();
 	threads::lock mlock;
-	void clear_cache()
+	const unsigned char* read_page(size_t page) const { return pages.find(page)->second.read().content; }
+	void invalidate_sync_index(size_t page)
+	{
+		if(sync_index_valid > page)
+			sync_index_valid = page;
+	}
+	void update_sync_index();
+	void clear_cache() const
 	{
 		cache_page_num = 0;
 		cache_page_num--;
@@ -1360,7 +1432,7 @@ void frame::sync(bool x) throw()
 		backing[0] |= 1;
 	else
 		backing[0] &= ~1;
-	if(host) host->notify_sync_change((backing[0] & 1) - old);
+	if(host) host->notify_sync_change((backing[0] & 1) - old, backing);
 }
 
 void frame::deserialize(const char* buf)
@@ -1379,7 +1451,7 @@ void frame::deserialize(const char* buf)
 				offset++;
 		}
 	}
-	if(host) host->notify_sync_change(sync() - old);
+	if(host) host->notify_sync_change(sync() - old, backing);
 }
 
 
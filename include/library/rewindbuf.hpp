@@ -0,0 +1,106 @@
+#ifndef _library__rewindbuf__hpp__included__
+#define _library__rewindbuf__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+/**
+ * Memory-budgeted stack of delta-compressed snapshots.
+ *
+ * Each snapshot is stored XORed against the previous one and zero-run-length encoded. Every now and then a
+ * keyframe (encoded against all-zeroes) is stored instead. The oldest entry is always a keyframe, so entries can
+ * be dropped from the bottom when memory budget is exceeded.
+ *
+ * The topmost snapshot is kept in decoded form, so popping normally only needs to decode one delta.
+ */
+class rewind_buffer
+{
+public:
+/**
+ * Create a new buffer.
+ *
+ * Parameter budget: The maximum amount of memory to use for encoded snapshots, in bytes.
+ * Parameter keyframe_interval: Store keyframe every this many snapshots.
+ */
+	rewind_buffer(size_t budget, unsigned keyframe_interval) throw();
+/**
+ * Set the limits. Entries over the new budget are discarded.
+ *
+ * Parameter budget: The maximum amount of memory to use for encoded snapshots, in bytes.
+ * Parameter keyframe_interval: Store keyframe every this many snapshots.
+ * Returns: Number of entries discarded from the bottom of stack.
+ */
+	size_t set_limits(size_t budget, unsigned keyframe_interval);
+/**
+ * Push a new snapshot on top of the stack.
+ *
+ * Parameter data: The snapshot data.
+ * Parameter size: The size of snapshot data.
+ * Returns: Number of entries discarded from the bottom of stack due to the budget.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	size_t push(const char* data, size_t size);
+/**
+ * Pop the topmost snapshot.
+ *
+ * Parameter out: The snapshot is written here.
+ * Returns: True if snapshot was popped, false if the stack was empty.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	bool pop(std::vector<char>& out);
+/**
+ * Discard all snapshots.
+ */
+	void clear() throw();
+/**
+ * Get number of snapshots in stack.
+ */
+	size_t size() const throw() { return entries.size(); }
+/**
+ * Get amount of memory used by encoded snapshots.
+ */
+	size_t memory_usage() const throw() { return used; }
+/**
+ * Get encoded size of topmost snapshot (0 if none).
+ */
+	size_t last_encoded_size() const throw() { return entries.empty() ? 0 : entries.back().data.size(); }
+/**
+ * Zero-run-length encode XOR of two buffers.
+ *
+ * Parameter out: The encoded data is appended here.
+ * Parameter data: The data to encode.
+ * Parameter ref: The reference data, or NULL for all-zeroes reference.
+ * Parameter size: Size of data and reference.
+ */
+	static void encode(std::vector<char>& out, const char* data, const char* ref, size_t size);
+/**
+ * XOR encoded data into buffer.
+ *
+ * Parameter target: The buffer to XOR into.
+ * Parameter size: Size of target buffer.
+ * Parameter enc: The encoded data.
+ * Parameter encsize: Size of encoded data.
+ * Throws std::runtime_error: Encoded data is corrupt.
+ */
+	static void decode_xor(char* target, size_t size, const char* enc, size_t encsize);
+private:
+	struct entry
+	{
+		std::vector<char> data;
+		size_t rawsize;
+		bool keyframe;
+	};
+	size_t trim();
+	void rebuild_top();
+	std::deque<entry> entries;
+	std::vector<char> top;
+	std::vector<char> scratch;
+	size_t used;
+	size_t budget;
+	unsigned keyframe_interval;
+	unsigned since_keyframe;
+};
+
+#endif
@@ -32,6 +32,14 @@ inline id this_id()
 {
 	return std::this_thread::get_id();
 }
+inline void yield()
+{
+	std::this_thread::yield();
+}
+inline unsigned hardware_concurrency()
+{
+	return std::thread::hardware_concurrency();
+}
 #else
 typedef boost::thread thread;
 typedef boost::condition_variable cv;
@@ -49,6 +57,14 @@ inline id this_id()
 {
 	return boost::this_thread::get_id();
 }
+inline void yield()
+{
+	boost::this_thread::yield();
+}
+inline unsigned hardware_concurrency()
+{
+	return boost::thread::hardware_concurrency();
+}
 #endif
 
 /**
@@ -17,6 +17,10 @@ struct lua_unsaferewind
 	{
 		return (stringfmt() << "to frame " << console_state.save_frame).str();
 	}
+	//Serialize the rewind point (without screenshot) to bytes, e.g. for sending to another process.
+	void serialize(std::vector<char>& out);
+	//Load rewind point serialized by serialize().
+	void unserialize(const char* in, size_t insize);
 };
 
 #endif
@@ -275,13 +275,12 @@ struct avi_output_stream
  * Flush frame and associtated samples from queue.
  *
  * Parameter frame: The frame to write.
- * Parameter oframe: The frame to delete if written.
  * Parameter stride: The stride between rows in pixels.
  * Parameter aqueue: The audio queue.
  * Parameter force: Read the frame even if there aren't enough sound samples.
  * Returns: True if frame was read, false otherwise.
  */
-	bool readqueue(uint32_t* frame, uint32_t* oframe, uint32_t stride, sample_queue& aqueue, bool force);
+	bool readqueue(uint32_t* frame, uint32_t stride, sample_queue& aqueue, bool force);
 /**
  * End a segment.
  */
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <fstream>
+#include <functional>
 #include "video/avi/codec.hpp"
 #include "samplequeue.hpp"
 
@@ -26,6 +27,12 @@ public:
  * Get the video queue.
  */
 	std::deque<frame_object>& video_queue();
+/**
+ * Set function to call on frames after those have been written. The default frees the frame data with delete[].
+ *
+ * Parameter fn: The function to call.
+ */
+	void set_frame_release(std::function<void(frame_object& f)> fn);
 /**
  * Get the audio queue.
  */
@@ -44,6 +51,7 @@ private:
 	std::string prefix;
 	uint64_t next_segment;
 	std::deque<frame_object> vqueue;
+	std::function<void(frame_object& f)> frame_release;
 	sample_queue aqueue;
 	avi_output_stream aviout;
 	std::ofstream avifile;
@@ -47,6 +47,17 @@ public:
 	{
 		sample2<0>(a...);
 	}
+
+/**
+ * Dump a block of 16-bit samples.
+ *
+ * parameter samples: The samples. Left and right channels are interleaved if stereo.
+ * parameter count: Number of samples (sample pairs if stereo).
+ * parameter stereo: If true, the samples are stereo, otherwise mono (copied to both channels).
+ *
+ * throws std::runtime_error: Error writing samples.
+ */
+	void samples(const int16_t* samples, size_t count, bool stereo);
 private:
 	template<size_t o>
 	void sample2()
@@ -90,6 +101,7 @@ private:
 
 	void internal_dump_sample();
 	std::vector<char> databuf;
+	std::vector<char> blockbuf;
 	std::vector<int32_t> samplebuffer;
 	std::ofstream sox_file;
 	uint64_t samples_dumped;
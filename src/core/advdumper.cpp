@@ -173,6 +173,16 @@ dumper_base::dumper_base(master_dumper& _mdumper, dumper_factory_base& _fbase)
 	samples_killed = 0;
 }
 
+void dumper_base::on_samples(const int16_t* samples, size_t count, bool stereo)
+{
+	if(stereo)
+		for(size_t i = 0; i < count; i++)
+			on_sample(samples[2 * i + 0], samples[2 * i + 1]);
+	else
+		for(size_t i = 0; i < count; i++)
+			on_sample(samples[i], samples[i]);
+}
+
 dumper_base::~dumper_base() throw()
 {
 	if(!mdumper) return;
@@ -191,6 +201,7 @@ master_dumper::master_dumper(lua_state& _lua2)
 	current_rate_n = 48000;
 	current_rate_d = 1;
 	output = &std::cerr;
+	shared_valid = false;
 }
 
 dumper_base* master_dumper::get_instance(dumper_factory_base* f) throw()
@@ -258,6 +269,8 @@ unsigned master_dumper::get_dumper_count() throw()
 void master_dumper::on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
 {
 	threads::arlock h(lock);
+	//The shared converted frame is for this frame only.
+	shared_valid = false;
 	for(auto i : sdumpers)
 		try {
 			i->on_frame(_frame, fps_n, fps_d);
@@ -273,10 +286,8 @@ void master_dumper::on_sample(short l, short r)
 	threads::arlock h(lock);
 	for(auto i : sdumpers)
 		try {
-			if(__builtin_expect(i->samples_killed, 0)) {
-				i->samples_killed--;
+			if(i->kill_sample())
 				continue;
-			}
 			i->on_sample(l, r);
 		} catch(std::exception& e) {
 			(*output) << "Error in on_sample: " << e.what() << std::endl;
@@ -285,6 +296,21 @@ void master_dumper::on_sample(short l, short r)
 		}
 }
 
+void master_dumper::on_samples(const int16_t* samples, size_t count, bool stereo)
+{
+	threads::arlock h(lock);
+	for(auto i : sdumpers)
+		try {
+			size_t killed = i->kill_samples(count);
+			if(killed < count)
+				i->on_samples(samples + (stereo ? 2 : 1) * killed, count - killed, stereo);
+		} catch(std::exception& e) {
+			(*output) << "Error in on_samples: " << e.what() << std::endl;
+		} catch(...) {
+			(*output) << "Error in on_samples: <unknown error>" << std::endl;
+		}
+}
+
 void master_dumper::on_rate_change(uint32_t n, uint32_t d)
 {
 	threads::arlock h(lock);
@@ -344,13 +370,11 @@ void master_dumper::set_output(std::ostream* _output)
 	output = _output;
 }
 
-template<bool X> bool master_dumper::render_video_hud(struct framebuffer::fb<X>& target,
-	struct framebuffer::raw& source, uint32_t hscl, uint32_t vscl, uint32_t lgap, uint32_t tgap, uint32_t rgap,
-	uint32_t bgap, std::function<void()> fn)
+bool master_dumper::run_video_hud(struct framebuffer::queue& rq, struct framebuffer::raw& source, uint32_t hscl,
+	uint32_t vscl, uint32_t& lgap, uint32_t& tgap, uint32_t& rgap, uint32_t& bgap, std::function<void()> fn)
 {
 	bool lua_kill_video = false;
 	struct lua::render_context lrc;
-	framebuffer::queue rq;
 	lrc.left_gap = lgap;
 	lrc.right_gap = rgap;
 	lrc.bottom_gap = bgap;
@@ -361,12 +385,48 @@ template<bool X> bool master_dumper::render_video_hud(struct framebuffer::fb<X>&
 	lua2.callback_do_video(&lrc, lua_kill_video, hscl, vscl);
 	if(fn)
 		fn();
-	target.reallocate(lrc.left_gap + source.get_width() * hscl + lrc.right_gap, lrc.top_gap +
-		source.get_height() * vscl + lrc.bottom_gap, false);
-	target.set_origin(lrc.left_gap, lrc.top_gap);
+	lgap = lrc.left_gap;
+	rgap = lrc.right_gap;
+	tgap = lrc.top_gap;
+	bgap = lrc.bottom_gap;
+	return !lua_kill_video;
+}
+
+template<bool X> bool master_dumper::render_video_hud(struct framebuffer::fb<X>& target,
+	struct framebuffer::raw& source, uint32_t hscl, uint32_t vscl, uint32_t lgap, uint32_t tgap, uint32_t rgap,
+	uint32_t bgap, std::function<void()> fn)
+{
+	framebuffer::queue rq;
+	bool r = run_video_hud(rq, source, hscl, vscl, lgap, tgap, rgap, bgap, fn);
+	target.reallocate(lgap + source.get_width() * hscl + rgap, tgap + source.get_height() * vscl + bgap, false);
+	target.set_origin(lgap, tgap);
 	target.copy_from(source, hscl, vscl);
 	rq.run(target);
-	return !lua_kill_video;
+	return r;
+}
+
+const framebuffer::fb<false>* master_dumper::render_video_hud_shared(struct framebuffer::fb<false>& target,
+	struct framebuffer::raw& source, uint32_t hscl, uint32_t vscl, uint32_t lgap, uint32_t tgap, uint32_t rgap,
+	uint32_t bgap, std::function<void()> fn)
+{
+	framebuffer::queue rq;
+	if(!run_video_hud(rq, source, hscl, vscl, lgap, tgap, rgap, bgap, fn))
+		return NULL;
+	if(rq.empty() && hscl == 1 && vscl == 1 && !lgap && !tgap && !rgap && !bgap) {
+		//Nothing dumper-specific in the frame, so all dumpers can share the same conversion.
+		if(!shared_valid) {
+			shared_frame.reallocate(source.get_width(), source.get_height(), false);
+			shared_frame.set_origin(0, 0);
+			shared_frame.copy_from(source, 1, 1);
+			shared_valid = true;
+		}
+		return &shared_frame;
+	}
+	target.reallocate(lgap + source.get_width() * hscl + rgap, tgap + source.get_height() * vscl + bgap, false);
+	target.set_origin(lgap, tgap);
+	target.copy_from(source, hscl, vscl);
+	rq.run(target);
+	return &target;
 }
 
 uint64_t master_dumper::killed_audio_length(uint32_t fps_n, uint32_t fps_d, double& fraction)
@@ -214,12 +214,7 @@ void audioapi_instance::record_voice(float* samples, size_t count)
 
 void audioapi_instance::submit_buffer(int16_t* samples, size_t count, bool stereo, double rate)
 {
-	if(stereo)
-		for(unsigned i = 0; i < count; i++)
-			CORE().mdumper->on_sample(samples[2 * i + 0], samples[2 * i + 1]);
-	else
-		for(unsigned i = 0; i < count; i++)
-			CORE().mdumper->on_sample(samples[i], samples[i]);
+	CORE().mdumper->on_samples(samples, count, stereo);
 	//Limit buffers to avoid overrunning.
 	if(count > music_bufsize / (stereo ? 2 : 1))
 		count = music_bufsize / (stereo ? 2 : 1);
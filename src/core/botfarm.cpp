@@ -0,0 +1,385 @@
+#include "core/botfarm.hpp"
+#include "library/serialization.hpp"
+#include "library/string.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#define BOTFARM_SUPPORTED
+#endif
+
+namespace
+{
+	//Message is header (id, data size, state size, error size; 64-bit little-endian each), followed by data,
+	//state and error.
+	const size_t header_size = 32;
+	//Sanity limit for message fields.
+	const uint64_t max_field = 1ULL << 30;
+
+	int worker_in = -1;
+	int worker_out = -1;
+
+	void encode(std::vector<char>& out, const botfarm_message& m)
+	{
+		out.resize(header_size + m.data.size() + m.state.size() + m.error.size());
+		serialization::u64l(&out[0], m.id);
+		serialization::u64l(&out[8], m.data.size());
+		serialization::u64l(&out[16], m.state.size());
+		serialization::u64l(&out[24], m.error.size());
+		char* p = &out[header_size];
+		std::copy(m.data.begin(), m.data.end(), p);
+		p += m.data.size();
+		std::copy(m.state.begin(), m.state.end(), p);
+		p += m.state.size();
+		std::copy(m.error.begin(), m.error.end(), p);
+	}
+
+	//Returns total size of message starting with the header, or 0 if the header is bad.
+	size_t decode_header(const char* h, botfarm_message& m, size_t& dsize, size_t& ssize, size_t& esize)
+	{
+		m.id = serialization::u64l(h);
+		uint64_t d = serialization::u64l(h + 8);
+		uint64_t s = serialization::u64l(h + 16);
+		uint64_t e = serialization::u64l(h + 24);
+		if(d > max_field || s > max_field || e > max_field)
+			return 0;
+		dsize = d;
+		ssize = s;
+		esize = e;
+		return header_size + dsize + ssize + esize;
+	}
+
+	void decode_body(const char* b, botfarm_message& m, size_t dsize, size_t ssize, size_t esize)
+	{
+		m.data.assign(b, b + dsize);
+		m.state.assign(b + dsize, b + dsize + ssize);
+		m.error.assign(b + dsize + ssize, b + dsize + ssize + esize);
+	}
+
+#ifdef BOTFARM_SUPPORTED
+	bool write_all(int fd, const char* buf, size_t size)
+	{
+		while(size > 0) {
+			ssize_t r = write(fd, buf, size);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r <= 0)
+				return false;
+			buf += r;
+			size -= r;
+		}
+		return true;
+	}
+
+	//Returns number of bytes read, which is less than size only on EOF.
+	size_t read_all(int fd, char* buf, size_t size)
+	{
+		size_t done = 0;
+		while(done < size) {
+			ssize_t r = read(fd, buf + done, size - done);
+			if(r < 0 && errno == EINTR)
+				continue;
+			if(r < 0)
+				throw std::runtime_error(std::string("Error reading job: ") + strerror(errno));
+			if(r == 0)
+				break;
+			done += r;
+		}
+		return done;
+	}
+
+	void set_cloexec(int fd)
+	{
+		fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+	}
+#endif
+}
+
+botfarm_coordinator::botfarm_coordinator(unsigned workers, const std::vector<std::string>& argv,
+	const std::string& log)
+{
+	running = 0;
+	next_id = 1;
+#ifdef BOTFARM_SUPPORTED
+	if(argv.empty())
+		throw std::runtime_error("No worker program");
+	//Dead workers are detected from write errors instead.
+	signal(SIGPIPE, SIG_IGN);
+	std::vector<char*> cargv;
+	for(auto& i : argv)
+		cargv.push_back(const_cast<char*>(i.c_str()));
+	cargv.push_back(NULL);
+	try {
+		for(unsigned i = 0; i < workers; i++) {
+			std::string logname = (log != "") ? (stringfmt() << log << i << ".log").str() :
+				std::string("/dev/null");
+			int tw[2], fw[2];
+			if(pipe(tw) < 0)
+				throw std::runtime_error("Can't create pipe for worker");
+			if(pipe(fw) < 0) {
+				close(tw[0]);
+				close(tw[1]);
+				throw std::runtime_error("Can't create pipe for worker");
+			}
+			//Other workers must not inherit the pipes, or closing them would not signal EOF.
+			set_cloexec(tw[0]);
+			set_cloexec(tw[1]);
+			set_cloexec(fw[0]);
+			set_cloexec(fw[1]);
+			int pid = fork();
+			if(pid < 0) {
+				close(tw[0]);
+				close(tw[1]);
+				close(fw[0]);
+				close(fw[1]);
+				throw std::runtime_error("Can't start worker process");
+			}
+			if(pid == 0) {
+				int in = tw[0];
+				int out = fw[1];
+				if(out == 3)
+					out = dup(out);
+				dup2(in, 3);
+				dup2(out, 4);
+				fcntl(3, F_SETFD, 0);
+				fcntl(4, F_SETFD, 0);
+				int fd = open(logname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+				if(fd >= 0) {
+					dup2(fd, 1);
+					dup2(fd, 2);
+					close(fd);
+				}
+				execvp(cargv[0], &cargv[0]);
+				_exit(127);
+			}
+			close(tw[0]);
+			close(fw[1]);
+			fcntl(fw[0], F_SETFL, fcntl(fw[0], F_GETFL) | O_NONBLOCK);
+			slot s;
+			s.pid = pid;
+			s.to = tw[1];
+			s.from = fw[0];
+			s.busy = false;
+			slots.push_back(s);
+		}
+	} catch(...) {
+		shutdown();
+		throw;
+	}
+#else
+	throw std::runtime_error("Bot farm is not supported on this platform");
+#endif
+}
+
+botfarm_coordinator::~botfarm_coordinator() throw()
+{
+	shutdown();
+}
+
+void botfarm_coordinator::shutdown() throw()
+{
+#ifdef BOTFARM_SUPPORTED
+	for(auto& i : slots) {
+		close(i.to);
+		close(i.from);
+		kill(i.pid, SIGTERM);
+	}
+	for(auto& i : slots) {
+		int status;
+		while(waitpid(i.pid, &status, 0) < 0 && errno == EINTR);
+	}
+#endif
+	slots.clear();
+}
+
+uint64_t botfarm_coordinator::submit(const std::string& data, const std::vector<char>& state)
+{
+	botfarm_message m;
+	m.id = next_id++;
+	m.data = data;
+	m.state = state;
+	queue.push_back(m);
+	dispatch();
+	return m.id;
+}
+
+void botfarm_coordinator::dispatch()
+{
+#ifdef BOTFARM_SUPPORTED
+	std::vector<char> buf;
+	for(size_t i = 0; i < slots.size() && !queue.empty(); i++) {
+		if(slots[i].busy)
+			continue;
+		//Free worker is waiting for job, so this does not block for long.
+		encode(buf, queue.front());
+		if(!write_all(slots[i].to, &buf[0], buf.size())) {
+			//Worker has died. The job stays queued for other workers.
+			std::list<botfarm_message> dummy;
+			kill_slot(i--, dummy, "");
+			continue;
+		}
+		slots[i].job = queue.front();
+		queue.pop_front();
+		slots[i].busy = true;
+		running++;
+	}
+#endif
+}
+
+bool botfarm_coordinator::read_results(slot& s, std::list<botfarm_message>& out)
+{
+#ifdef BOTFARM_SUPPORTED
+	char buf[65536];
+	bool eof = false;
+	while(true) {
+		ssize_t r = read(s.from, buf, sizeof(buf));
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if(r <= 0) {
+			eof = true;
+			break;
+		}
+		s.rbuf.insert(s.rbuf.end(), buf, buf + r);
+	}
+	size_t off = 0;
+	while(s.rbuf.size() - off >= header_size) {
+		botfarm_message m;
+		size_t dsize, ssize, esize;
+		size_t total = decode_header(&s.rbuf[off], m, dsize, ssize, esize);
+		if(!total)
+			return false;
+		if(s.rbuf.size() - off < total)
+			break;
+		decode_body(&s.rbuf[off + header_size], m, dsize, ssize, esize);
+		off += total;
+		if(s.busy && m.id == s.job.id) {
+			out.push_back(m);
+			s.busy = false;
+			running--;
+		}
+	}
+	s.rbuf.erase(s.rbuf.begin(), s.rbuf.begin() + off);
+	return !eof;
+#else
+	return false;
+#endif
+}
+
+void botfarm_coordinator::kill_slot(size_t i, std::list<botfarm_message>& out, const std::string& why)
+{
+	slot& s = slots[i];
+	if(s.busy) {
+		botfarm_message m;
+		m.id = s.job.id;
+		m.error = why;
+		out.push_back(m);
+		running--;
+	}
+#ifdef BOTFARM_SUPPORTED
+	close(s.to);
+	close(s.from);
+	kill(s.pid, SIGTERM);
+	int status;
+	while(waitpid(s.pid, &status, 0) < 0 && errno == EINTR);
+#endif
+	slots.erase(slots.begin() + i);
+}
+
+void botfarm_coordinator::poll(std::list<botfarm_message>& out, int timeout)
+{
+#ifdef BOTFARM_SUPPORTED
+	size_t before = out.size();
+	dispatch();
+	while(running) {
+		std::vector<struct pollfd> fds;
+		std::vector<size_t> idx;
+		for(size_t i = 0; i < slots.size(); i++) {
+			if(!slots[i].busy)
+				continue;
+			struct pollfd p;
+			p.fd = slots[i].from;
+			p.events = POLLIN;
+			p.revents = 0;
+			fds.push_back(p);
+			idx.push_back(i);
+		}
+		int r = ::poll(&fds[0], fds.size(), (out.size() > before) ? 0 : timeout);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0)
+			break;
+		//Backwards, so killing a slot does not move the ones still to be checked.
+		for(size_t j = fds.size(); j > 0; j--) {
+			if(!fds[j - 1].revents)
+				continue;
+			if(!read_results(slots[idx[j - 1]], out))
+				kill_slot(idx[j - 1], out, "Worker died");
+		}
+		dispatch();
+		if(out.size() > before || timeout >= 0)
+			break;
+	}
+#endif
+	if(slots.empty())
+		while(!queue.empty()) {
+			queue.front().error = "No workers left";
+			queue.front().data = "";
+			queue.front().state.clear();
+			out.push_back(queue.front());
+			queue.pop_front();
+		}
+}
+
+void botfarm_worker_init(int in, int out)
+{
+	worker_in = in;
+	worker_out = out;
+}
+
+bool botfarm_is_worker()
+{
+	return (worker_in >= 0);
+}
+
+bool botfarm_worker_get_job(botfarm_message& job)
+{
+	if(worker_in < 0)
+		throw std::runtime_error("Not a bot farm worker");
+#ifdef BOTFARM_SUPPORTED
+	char h[header_size];
+	size_t r = read_all(worker_in, h, header_size);
+	if(r == 0)
+		return false;
+	size_t dsize, ssize, esize;
+	size_t total = (r == header_size) ? decode_header(h, job, dsize, ssize, esize) : 0;
+	if(!total)
+		throw std::runtime_error("Bad job from coordinator");
+	std::vector<char> body(total - header_size);
+	if(read_all(worker_in, body.data(), body.size()) < body.size())
+		throw std::runtime_error("Job from coordinator truncated");
+	decode_body(body.data(), job, dsize, ssize, esize);
+	return true;
+#else
+	return false;
+#endif
+}
+
+void botfarm_worker_put_result(const botfarm_message& result)
+{
+	if(worker_out < 0)
+		throw std::runtime_error("Not a bot farm worker");
+#ifdef BOTFARM_SUPPORTED
+	std::vector<char> buf;
+	encode(buf, result);
+	if(!write_all(worker_out, &buf[0], buf.size()))
+		throw std::runtime_error("Can't send result to coordinator");
+#endif
+}
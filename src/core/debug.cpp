@@ -9,12 +9,15 @@
 #include "core/rom.hpp"
 #include "library/directory.hpp"
 #include "library/memoryspace.hpp"
+#include "library/workthread.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <stdexcept>
 #include <list>
 #include <map>
 #include <fstream>
+#include <cstring>
 
 
 namespace
@@ -66,6 +69,64 @@ debug_context::callback_base::~callback_base()
 
 const uint64_t debug_context::all_addresses = 0xFFFFFFFFFFFFFFFFULL;
 
+debug_context::hook_index::hook_index()
+{
+	used = 0;
+}
+
+void debug_context::hook_index::set(uint64_t addr, cb_list* list)
+{
+	//Keep the load factor at most 1/2.
+	if(2 * (used + 1) > slots.size()) {
+		std::vector<slot> old;
+		old.swap(slots);
+		slots.resize(old.empty() ? 16 : 2 * old.size());
+		for(auto& i : slots)
+			i.list = NULL;
+		used = 0;
+		for(auto& i : old)
+			if(i.list)
+				set(i.addr, i.list);
+	}
+	size_t mask = slots.size() - 1;
+	size_t i = hash(addr) & mask;
+	while(slots[i].list && slots[i].addr != addr)
+		i = (i + 1) & mask;
+	if(!slots[i].list)
+		used++;
+	slots[i].addr = addr;
+	slots[i].list = list;
+}
+
+void debug_context::hook_index::erase(uint64_t addr) throw()
+{
+	if(!used)
+		return;
+	size_t mask = slots.size() - 1;
+	size_t i = hash(addr) & mask;
+	while(slots[i].list && slots[i].addr != addr)
+		i = (i + 1) & mask;
+	if(!slots[i].list)
+		return;
+	slots[i].list = NULL;
+	used--;
+	//Shift back the following entries that would no longer be found past the hole.
+	for(size_t j = (i + 1) & mask; slots[j].list; j = (j + 1) & mask) {
+		size_t home = hash(slots[j].addr) & mask;
+		if(((j - home) & mask) >= ((j - i) & mask)) {
+			slots[i] = slots[j];
+			slots[j].list = NULL;
+			i = j;
+		}
+	}
+}
+
+void debug_context::hook_index::clear() throw()
+{
+	slots.clear();
+	used = 0;
+}
+
 void debug_context::add_callback(uint64_t addr, debug_context::etype type, debug_context::callback_base& cb)
 {
 	auto& core = CORE();
@@ -78,43 +139,96 @@ void debug_context::add_callback(uint64_t addr, debug_context::etype type, debug
 		core.rom->set_debug_flags(addr, debug_flag(type), 0);
 	auto& lst = xcb[addr];
 	lst.push_back(&cb);
+	hook_index* idx = get_index(type);
+	if(idx)
+		idx->set(addr, &lst);
 }
 
 void debug_context::remove_callback(uint64_t addr, debug_context::etype type, debug_context::callback_base& cb)
 {
 	std::map<uint64_t, cb_list>& xcb = get_lists(type);
 	if(type == DEBUG_FRAME) addr = 0;
-	if(!xcb.count(addr)) return;
-	auto& l = xcb[addr];
-	for(auto i = l.begin(); i != l.end(); i++) {
+	auto l = xcb.find(addr);
+	if(l == xcb.end()) return;
+	for(auto i = l->second.begin(); i != l->second.end(); i++) {
 		if(*i == &cb) {
-			l.erase(i);
+			//Callbacks may be running from this list, so just mark the entry dead for now.
+			if(dispatch_depth) {
+				*i = NULL;
+				sweep_needed = true;
+				return;
+			}
+			l->second.erase(i);
 			break;
 		}
 	}
-	if(xcb[addr].empty()) {
-		xcb.erase(addr);
+	if(l->second.empty()) {
+		hook_index* idx = get_index(type);
+		if(idx)
+			idx->erase(addr);
+		xcb.erase(l);
 		if(type != DEBUG_FRAME)
 			rom.set_debug_flags(addr, 0, debug_flag(type));
 	}
 }
 
+void debug_context::sweep_callbacks()
+{
+	sweep_needed = false;
+	etype types[] = {DEBUG_READ, DEBUG_WRITE, DEBUG_EXEC, DEBUG_TRACE, DEBUG_FRAME};
+	for(auto type : types) {
+		std::map<uint64_t, cb_list>& xcb = get_lists(type);
+		for(auto i = xcb.begin(); i != xcb.end();) {
+			auto& l = i->second;
+			l.erase(std::remove(l.begin(), l.end(), (callback_base*)NULL), l.end());
+			if(!l.empty()) {
+				i++;
+				continue;
+			}
+			uint64_t addr = i->first;
+			hook_index* idx = get_index(type);
+			if(idx)
+				idx->erase(addr);
+			xcb.erase(i++);
+			if(type != DEBUG_FRAME)
+				rom.set_debug_flags(addr, 0, debug_flag(type));
+		}
+	}
+}
+
+void debug_context::run_callbacks(cb_list* lst1, cb_list* lst2, const params& p, bool enable1)
+{
+	if(!lst1 && !lst2)
+		return;
+	//Lists are not copied, callbacks added while running are not called and removed ones are only marked dead.
+	//Only look at the entries there were at the start.
+	size_t n1 = (lst1 && enable1) ? lst1->size() : 0;
+	size_t n2 = lst2 ? lst2->size() : 0;
+	requesting_break = false;
+	dispatch_depth++;
+	try {
+		for(size_t i = 0; i < n1; i++)
+			if((*lst1)[i]) (*lst1)[i]->callback(p);
+		for(size_t i = 0; i < n2; i++)
+			if((*lst2)[i]) (*lst2)[i]->callback(p);
+	} catch(...) {
+		if(!--dispatch_depth && sweep_needed)
+			sweep_callbacks();
+		throw;
+	}
+	if(!--dispatch_depth && sweep_needed)
+		sweep_callbacks();
+	if(requesting_break && p.type != DEBUG_FRAME)
+		do_break_pause();
+}
+
 void debug_context::do_callback_read(uint64_t addr, uint64_t value)
 {
 	params p;
 	p.type = DEBUG_READ;
 	p.rwx.addr = addr;
 	p.rwx.value = value;
-
-	requesting_break = false;
-	cb_list* cb1 = read_cb.count(all_addresses) ? &read_cb[all_addresses] : &dummy_cb;
-	cb_list* cb2 = read_cb.count(addr) ? &read_cb[addr] : &dummy_cb;
-	auto _cb1 = *cb1;
-	auto _cb2 = *cb2;
-	for(auto& i : _cb1) i->callback(p);
-	for(auto& i : _cb2) i->callback(p);
-	if(requesting_break)
-		do_break_pause();
+	run_callbacks(read_idx.find(all_addresses), read_idx.find(addr), p);
 }
 
 void debug_context::do_callback_write(uint64_t addr, uint64_t value)
@@ -123,16 +237,7 @@ void debug_context::do_callback_write(uint64_t addr, uint64_t value)
 	p.type = DEBUG_WRITE;
 	p.rwx.addr = addr;
 	p.rwx.value = value;
-
-	requesting_break = false;
-	cb_list* cb1 = write_cb.count(all_addresses) ? &write_cb[all_addresses] : &dummy_cb;
-	cb_list* cb2 = write_cb.count(addr) ? &write_cb[addr] : &dummy_cb;
-	auto _cb1 = *cb1;
-	auto _cb2 = *cb2;
-	for(auto& i : _cb1) i->callback(p);
-	for(auto& i : _cb2) i->callback(p);
-	if(requesting_break)
-		do_break_pause();
+	run_callbacks(write_idx.find(all_addresses), write_idx.find(addr), p);
 }
 
 void debug_context::do_callback_exec(uint64_t addr, uint64_t cpu)
@@ -141,17 +246,7 @@ void debug_context::do_callback_exec(uint64_t addr, uint64_t cpu)
 	p.type = DEBUG_EXEC;
 	p.rwx.addr = addr;
 	p.rwx.value = cpu;
-
-	requesting_break = false;
-	cb_list* cb1 = exec_cb.count(all_addresses) ? &exec_cb[all_addresses] : &dummy_cb;
-	cb_list* cb2 = exec_cb.count(addr) ? &exec_cb[addr] : &dummy_cb;
-	auto _cb1 = *cb1;
-	auto _cb2 = *cb2;
-	if((1ULL << cpu) & xmask)
-		for(auto& i : _cb1) i->callback(p);
-	for(auto& i : _cb2) i->callback(p);
-	if(requesting_break)
-		do_break_pause();
+	run_callbacks(exec_idx.find(all_addresses), exec_idx.find(addr), p, (1ULL << cpu) & xmask);
 }
 
 void debug_context::do_callback_trace(uint64_t cpu, const char* str, bool true_insn)
@@ -161,13 +256,8 @@ void debug_context::do_callback_trace(uint64_t cpu, const char* str, bool true_i
 	p.trace.cpu = cpu;
 	p.trace.decoded_insn = str;
 	p.trace.true_insn = true_insn;
-
-	requesting_break = false;
-	cb_list* cb = trace_cb.count(cpu) ? &trace_cb[cpu] : &dummy_cb;
-	auto _cb = *cb;
-	for(auto& i : _cb) i->callback(p);
-	if(requesting_break)
-		do_break_pause();
+	auto i = trace_cb.find(cpu);
+	run_callbacks(NULL, (i != trace_cb.end()) ? &i->second : NULL, p);
 }
 
 void debug_context::do_callback_frame(uint64_t frame, bool loadstate)
@@ -176,10 +266,8 @@ void debug_context::do_callback_frame(uint64_t frame, bool loadstate)
 	p.type = DEBUG_FRAME;
 	p.frame.frame = frame;
 	p.frame.loadstated = loadstate;
-
-	cb_list* cb = frame_cb.count(0) ? &frame_cb[0] : &dummy_cb;
-	auto _cb = *cb;
-	for(auto& i : _cb) i->callback(p);
+	auto i = frame_cb.find(0);
+	run_callbacks(NULL, (i != frame_cb.end()) ? &i->second : NULL, p);
 }
 
 void debug_context::set_cheat(uint64_t addr, uint64_t value)
@@ -214,6 +302,9 @@ void debug_context::core_change()
 	kill_hooks(write_cb, DEBUG_WRITE);
 	kill_hooks(exec_cb, DEBUG_EXEC);
 	kill_hooks(trace_cb, DEBUG_TRACE);
+	read_idx.clear();
+	write_idx.clear();
+	exec_idx.clear();
 }
 
 void debug_context::request_break()
@@ -221,19 +312,104 @@ void debug_context::request_break()
 	requesting_break = true;
 }
 
-debug_context::tracelog_file::tracelog_file(debug_context& _parent)
+namespace
+{
+	//Trace data is handed to the writer thread in chunks of this size.
+	const size_t tracelog_chunk = 4 << 20;
+}
+
+#define WORKFLAG_WRITE 1
+
+//Writes the trace to file, so that the emulator thread never waits for disk unless it gets a full chunk ahead.
+struct debug_context::tracelog_writer : public workthread
+{
+	tracelog_writer(const std::string& filename)
+	{
+		stream.open(filename, std::ios::out | std::ios::binary);
+		if(!stream)
+			throw std::runtime_error("Can't open '" + filename + "'");
+		error = false;
+		fire();
+	}
+	//Hands the data to writer thread. Data is replaced by an empty buffer.
+	void queue(std::vector<char>& data)
+	{
+		wait_busy();
+		pending.swap(data);
+		data.clear();
+		set_busy();
+		set_workflag(WORKFLAG_WRITE);
+	}
+	//Waits for pending write and checks if any write has failed.
+	bool failed()
+	{
+		wait_busy();
+		return error;
+	}
+	void entry()
+	{
+		while(1) {
+			wait_workflag();
+			uint32_t work = clear_workflag(~workthread::quit_request);
+			if(work & WORKFLAG_WRITE) {
+				stream.write(&pending[0], pending.size());
+				stream.flush();
+				if(!stream)
+					error = true;
+				pending.clear();
+				clear_workflag(WORKFLAG_WRITE);
+				clear_busy();
+			}
+			if(work == workthread::quit_request)
+				break;
+		}
+	}
+private:
+	std::ofstream stream;
+	std::vector<char> pending;
+	bool error;
+};
+
+debug_context::tracelog_file::tracelog_file(debug_context& _parent, const std::string& filename)
 	: parent(_parent)
 {
+	writer = new tracelog_writer(filename);
+	buffer.reserve(tracelog_chunk);
+	failed = false;
 }
 
 debug_context::tracelog_file::~tracelog_file()
 {
+	try {
+		flush();
+	} catch(...) {
+	}
+	writer->request_quit();
+	delete writer;
 }
 
 void debug_context::tracelog_file::callback(const debug_context::params& p)
 {
 	if(!parent.trace_outputs.count(p.trace.cpu)) return;
-	parent.trace_outputs[p.trace.cpu]->stream << p.trace.decoded_insn << std::endl;
+	size_t len = strlen(p.trace.decoded_insn);
+	size_t base = buffer.size();
+	buffer.resize(base + len + 1);
+	memcpy(&buffer[base], p.trace.decoded_insn, len);
+	buffer[base + len] = '\n';
+	if(buffer.size() >= tracelog_chunk) {
+		writer->queue(buffer);
+		buffer.reserve(tracelog_chunk);
+	}
+}
+
+void debug_context::tracelog_file::flush()
+{
+	if(!buffer.empty())
+		writer->queue(buffer);
+	if(writer->failed() && !failed) {
+		messages << "Error writing tracelog '" << full_filename << "'" << std::endl;
+		failed = true;
+	}
 }
 
 void debug_context::tracelog_file::killed(uint64_t addr, debug_context::etype type)
@@ -249,6 +425,8 @@ void debug_context::tracelog(uint64_t proc, const std::string& filename)
 		if(!trace_outputs.count(proc))
 			return;
 		remove_callback(proc, DEBUG_TRACE, *trace_outputs[proc]);
+		//Other processors may keep the file open, but get everything traced so far on disk now.
+		trace_outputs[proc]->flush();
 		trace_outputs[proc]->refcnt--;
 		if(!trace_outputs[proc]->refcnt)
 			delete trace_outputs[proc];
@@ -269,15 +447,10 @@ void debug_context::tracelog(uint64_t proc, const std::string& filename)
 		}
 	}
 	if(!found) {
-		trace_outputs[proc] = new tracelog_file(*this);
-		trace_outputs[proc]->refcnt = 1;
-		trace_outputs[proc]->full_filename = full_filename;
-		trace_outputs[proc]->stream.open(full_filename);
-		if(!trace_outputs[proc]->stream) {
-			delete trace_outputs[proc];
-			trace_outputs.erase(proc);
-			throw std::runtime_error("Can't open '" + full_filename + "'");
-		}
+		tracelog_file* f = new tracelog_file(*this, full_filename);
+		f->refcnt = 1;
+		f->full_filename = full_filename;
+		trace_outputs[proc] = f;
 	}
 	try {
 		add_callback(proc, DEBUG_TRACE, *trace_outputs[proc]);
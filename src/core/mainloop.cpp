@@ -24,6 +24,7 @@
 #include "core/project.hpp"
 #include "core/queue.hpp"
 #include "core/random.hpp"
+#include "core/rewind.hpp"
 #include "core/rom.hpp"
 #include "core/runmode.hpp"
 #include "core/settings.hpp"
@@ -59,6 +60,8 @@ namespace
 		"advance-subframe-timeout", "Delays‣Subframe advance", 100);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_pause_on_end(lsnes_setgrp,
 		"pause-on-end", "Movie‣Pause on end", false);
+	settingvar::supervariable<settingvar::model_int<1,9999>> SET_turbo_render_interval(lsnes_setgrp,
+		"turbo-render-interval", "Video‣Turbo render interval (frames)", 1);
 
 	//Mode and filename of pending load, one of LOAD_* constants.
 	int loadmode;
@@ -75,6 +78,26 @@ namespace
 	//Macro hold.
 	bool macro_hold_1;
 	bool macro_hold_2;
+	//Render suppression.
+	bool render_frame = true;
+	uint64_t frames_since_render = 0;
+
+	//Decide if the next frame will be shown. In turbo, only every Nth frame is rendered (never while dumping,
+	//as dumpers need every frame).
+	void update_render_flag()
+	{
+		auto& core = CORE();
+		unsigned interval = SET_turbo_render_interval(*core.settings);
+		bool turbo = core.framerate->turboed || core.framerate->get_speed_multiplier() ==
+			std::numeric_limits<double>::infinity();
+		if(interval > 1 && turbo && core.runmode->is_freerunning() && !core.mdumper->get_dumper_count())
+			render_frame = (++frames_since_render >= interval);
+		else
+			render_frame = true;
+		if(render_frame)
+			frames_since_render = 0;
+		core.rom->set_render(render_frame);
+	}
 }
 
 void mainloop_signal_need_rewind(void* ptr)
@@ -285,7 +308,8 @@ public:
 		auto& core = CORE();
 		core.lua2->callback_do_frame_emulated();
 		core.runmode->set_point(emulator_runmode::P_VIDEO);
-		core.fbuf->redraw_framebuffer(screen, false, true);
+		if(render_frame)
+			core.fbuf->redraw_framebuffer(screen, false, true);
 		auto rate = core.rom->get_audio_rate();
 		uint32_t gv = gcd(fps_n, fps_d);
 		uint32_t ga = gcd(rate.first, rate.second);
@@ -711,6 +735,24 @@ namespace
 		auto& core = CORE();
 		std::string old_project = *core.mlogic ? core.mlogic->get_mfile().projectid : "";
 jumpback:
+		if(rewind_requested() && *core.mlogic) {
+			try {
+				if(rewind_restore()) {
+					core.dispatch->mode_change(core.mlogic->get_movie().readonly_mode());
+					core.runmode->set_point(emulator_runmode::P_SAVE);
+					core.supdater->update();
+					return 1;
+				}
+			} catch(std::bad_alloc& e) {
+				OOM_panic();
+			} catch(std::exception& e) {
+				messages << "Rewind failed: " << e.what() << std::endl;
+				rewind_clear();
+			}
+			//Out of rewind points, stay at the oldest one.
+			if(!core.runmode->is_paused())
+				core.runmode->set_pause();
+		}
 		if(do_unsafe_rewind && unsafe_rewind_obj) {
 			if(!*core.mlogic)
 				return 0;
@@ -718,6 +760,7 @@ jumpback:
 			core.lua2->callback_do_unsafe_rewind(core.mlogic->get_movie(), unsafe_rewind_obj);
 			core.dispatch->mode_change(false);
 			do_unsafe_rewind = false;
+			rewind_clear();
 			core.runmode->set_point(emulator_runmode::P_SAVE);
 			core.supdater->update();
 			core.runmode->end_load();		//Restore previous mode.
@@ -736,6 +779,7 @@ jumpback:
 				core.project->set(&p);
 				if(core.project->get() != old)
 					delete old;
+				rewind_clear();
 				core.slotcache->flush();		//Wrong movie may be stale.
 				core.runmode->end_load();		//Restore previous mode.
 				if(core.mlogic->get_mfile().dyn.save_frame)
@@ -774,6 +818,7 @@ nothing_to_do:
 				messages << "Load failed: " << e.what() << std::endl;
 			}
 			pending_load = "";
+			rewind_clear();
 			if(!core.runmode->is_corrupt()) {
 				core.runmode->end_load();
 				core.runmode->set_point(emulator_runmode::P_SAVE);
@@ -797,8 +842,11 @@ nothing_to_do:
 		auto& core = CORE();
 		if(!*core.mlogic)
 			return;
-		if(!queued_saves.empty() || (do_unsafe_rewind && !unsafe_rewind_obj)) {
+		bool rewind_due = rewind_capture_due();
+		if(!queued_saves.empty() || (do_unsafe_rewind && !unsafe_rewind_obj) || rewind_due) {
 			core.rom->runtosave();
+			if(rewind_due)
+				rewind_capture();
 			for(auto i : queued_saves) {
 				do_save_state(i.first, i.second);
 				int tmp = -1;
@@ -806,7 +854,7 @@ nothing_to_do:
 			}
 			if(do_unsafe_rewind && !unsafe_rewind_obj) {
 				uint64_t t = framerate_regulator::get_utime();
-				core.mlogic->get_mfile().dyn.savestate = core.rom->save_core_state(true);
+				core.rom->save_core_state(core.mlogic->get_mfile().dyn.savestate, true);
 				core.lua2->callback_do_unsafe_rewind(core.mlogic->get_movie(), NULL);
 				do_unsafe_rewind = false;
 				messages << "Rewind point set in " << (framerate_regulator::get_utime() - t)
@@ -936,6 +984,7 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 			just_did_loadstate = false;
 		}
 		core.dbg->do_callback_frame(core.mlogic->get_movie().get_current_frame(), false);
+		update_render_flag();
 		core.rom->emulate();
 		random_mix_timing_entropy();
 		if(core.runmode->is_freerunning())
@@ -944,6 +993,7 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 		core.lua2->callback_do_frame();
 	}
 out:
+	wait_pending_saves();
 	core.jukebox->unset_update();
 	core.mdumper->end_dumps();
 	core.commentary->kill();
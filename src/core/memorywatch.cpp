@@ -106,7 +106,9 @@ namespace
 		regread_oper();
 		~regread_oper();
 		//The first promise is the register name.
-		void evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises);
+		void evaluate(mathexpr::value target,
+			const std::vector<std::function<mathexpr::value()>>& promises);
+		std::string share_key();
 		//Fields.
 		bool signed_flag;
 		loaded_rom* rom;
@@ -121,7 +123,14 @@ namespace
 	regread_oper::~regread_oper()
 	{
 	}
-	void regread_oper::evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises)
+	std::string regread_oper::share_key()
+	{
+		std::ostringstream x;
+		x << "R" << signed_flag << "," << rom;
+		return x.str();
+	}
+	void regread_oper::evaluate(mathexpr::value target,
+		const std::vector<std::function<mathexpr::value()>>& promises)
 	{
 		if(promises.size() != 1)
 			throw mathexpr::error(mathexpr::error::ARGCOUNT, "register read operator takes 1 argument");
@@ -569,7 +578,11 @@ void memwatch_set::rebuild(std::map<std::string, memwatch_item>& nitems)
 {
 	{
 		memorywatch::set new_set;
+		//Shares common subexpressions between the watches.
+		mathexpr::expr_pool pool;
 		std::map<std::string, GC::pointer<mathexpr::mathexpr>> vars;
+		//Watch each shared expression was installed as.
+		std::map<mathexpr::mathexpr*, std::string> installed;
 		auto vars_fn = [&vars](const std::string& n) -> GC::pointer<mathexpr::mathexpr> {
 			if(!vars.count(n))
 				vars[n] = GC::pointer<mathexpr::mathexpr>(GC::obj_tag(),
@@ -584,7 +597,7 @@ void memwatch_set::rebuild(std::map<std::string, memwatch_item>& nitems)
 				std::vector<GC::pointer<mathexpr::mathexpr>> v;
 				try {
 					rt_expr = mathexpr::mathexpr::parse(*mathexpr::expression_value(),
-						i.second.expr, vars_fn);
+						i.second.expr, vars_fn, &pool);
 				} catch(std::exception& e) {
 					(stringfmt() << "Error while parsing address/expression: "
 						<< e.what()).throwex();
@@ -594,6 +607,7 @@ void memwatch_set::rebuild(std::map<std::string, memwatch_item>& nitems)
 					rt_expr = GC::pointer<mathexpr::mathexpr>(GC::obj_tag(),
 						mathexpr::expression_value(), memread_oper, v, true);
 					memread_oper = NULL;
+					rt_expr = pool.intern(rt_expr);
 				}
 				rt_printer = i.second.printer.get_printer_obj(vars_fn);
 
@@ -605,7 +619,15 @@ void memwatch_set::rebuild(std::map<std::string, memwatch_item>& nitems)
 					});
 
 				memorywatch::item it(*mathexpr::expression_value());
-				*vars_fn(i.first) = *rt_expr;
+				//Watches reading the same value forward to the first one, so it is read only once.
+				mathexpr::mathexpr* shared = rt_expr.as_pointer();
+				if(installed.count(shared))
+					*vars_fn(i.first) = mathexpr::mathexpr(mathexpr::expression_value(),
+						vars_fn(installed[shared]));
+				else {
+					*vars_fn(i.first) = *rt_expr;
+					installed[shared] = i.first;
+				}
 				it.expr = vars_fn(i.first);
 				it.printer = rt_printer;
 				it.format = i.second.format;
@@ -12,6 +12,7 @@
 #include "core/messages.hpp"
 #include "core/moviedata.hpp"
 #include "core/project.hpp"
+#include "core/queue.hpp"
 #include "core/random.hpp"
 #include "core/rom.hpp"
 #include "core/runmode.hpp"
@@ -21,10 +22,12 @@
 #include "library/minmax.hpp"
 #include "library/string.hpp"
 #include "library/temporary_handle.hpp"
+#include "library/workthread.hpp"
 #include "lua/lua.hpp"
 
 #include <iomanip>
 #include <fstream>
+#include <deque>
 
 std::string last_save;
 
@@ -34,6 +37,8 @@ namespace
 		"Movie‣Saving‣Compression",  7);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_readonly_load_preserves(
 		lsnes_setgrp, "preserve_on_readonly_load", "Movie‣Loading‣Preserve on readonly load", true);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_async_save(lsnes_setgrp,
+		"async-save", "Movie‣Saving‣Write savestates in background", true);
 	threads::lock mprefix_lock;
 	std::string mprefix;
 	bool mprefix_valid;
@@ -47,6 +52,134 @@ namespace
 			return mprefix + "-";
 	}
 
+	//Savestate being written in background.
+	struct pending_save
+	{
+		moviefile* mv;
+		std::vector<char> rrdata;
+		std::string filename;
+		unsigned compression;
+		bool binary;
+		bool fast_checksum;
+		uint64_t start_time;
+		uint64_t sync_time;
+		uint64_t end_time;
+		bool oom;
+		std::string error;
+	};
+
+#define WORKFLAG_SAVE 1
+
+	//Writes savestates in background, one at a time in order queued.
+	class state_writer : public workthread
+	{
+	public:
+		state_writer()
+		{
+			fire();
+		}
+		void queue(pending_save* s)
+		{
+			{
+				threads::alock h(qlock);
+				queued.push_back(s);
+				set_busy();
+			}
+			set_workflag(WORKFLAG_SAVE);
+		}
+		//Report completed saves. Must be called from emulation thread.
+		void reap()
+		{
+			while(true) {
+				pending_save* s;
+				{
+					threads::alock h(qlock);
+					if(done.empty())
+						return;
+					s = done.front();
+					done.pop_front();
+				}
+				report(*s);
+				delete s->mv;
+				delete s;
+			}
+		}
+	protected:
+		void entry()
+		{
+			while(!(wait_workflag() & quit_request)) {
+				clear_workflag(WORKFLAG_SAVE);
+				while(true) {
+					pending_save* s;
+					{
+						threads::alock h(qlock);
+						if(queued.empty()) {
+							clear_busy();
+							break;
+						}
+						s = queued.front();
+					}
+					write(*s);
+					{
+						threads::alock h(qlock);
+						queued.pop_front();
+						done.push_back(s);
+					}
+					CORE().iqueue->run_async([this]() { this->reap(); }, [](std::exception& e) {});
+				}
+			}
+		}
+	private:
+		void write(pending_save& s)
+		{
+			try {
+				loaded_rom::append_core_state_checksum(s.mv->dyn.savestate, s.fast_checksum);
+				rrdata_set rrd;
+				rrd.read(s.rrdata);
+				s.mv->save(s.filename, s.compression, s.binary, rrd, true);
+				s.oom = false;
+			} catch(std::bad_alloc& e) {
+				s.oom = true;
+			} catch(std::exception& e) {
+				s.oom = false;
+				s.error = e.what();
+				if(s.error == "")
+					s.error = "Unknown error";
+			}
+			s.end_time = framerate_regulator::get_utime();
+		}
+		void report(pending_save& s)
+		{
+			auto& core = CORE();
+			if(s.oom)
+				OOM_panic();
+			if(s.error != "") {
+				platform::error_message(std::string("Save failed: ") + s.error);
+				messages << "Save failed: " << s.error << std::endl;
+				core.lua2->callback_err_save(s.filename);
+				return;
+			}
+			std::string kind = s.binary ? "(binary format)" : "(zip format)";
+			messages << "Saved state " << kind << " '" << s.filename << "' in " << s.sync_time
+				<< " microseconds (" << (s.end_time - s.start_time) << " microseconds total)."
+				<< std::endl;
+			core.slotcache->flush(s.filename);
+			core.lua2->callback_post_save(s.filename, true);
+		}
+		threads::lock qlock;
+		std::deque<pending_save*> queued;
+		std::deque<pending_save*> done;
+	};
+
+	state_writer& get_state_writer()
+	{
+		//Never freed, wait_pending_saves() makes sure nothing is in flight on exit.
+		static state_writer* w = new state_writer;
+		return *w;
+	}
+
+	bool state_writer_started = false;
+
 	command::fnptr<const std::string&> test4(lsnes_cmds, CMOVIEDATA::panic,
 		[](const std::string& args) {
 		auto& core = CORE();
@@ -224,6 +357,8 @@ void do_save_state(const std::string& filename, int binary)
 	}
 	auto& target = core.mlogic->get_mfile();
 	std::string filename2 = translate_name_mprefix(filename, binary, 1);
+	//Memory saves are just copies, nothing to gain by doing those in background.
+	bool async = SET_async_save(*core.settings) && !regex_match("\\$MEMORY:.*", filename2);
 	core.lua2->callback_pre_save(filename2, true);
 	try {
 		uint64_t origtime = framerate_regulator::get_utime();
@@ -235,7 +370,8 @@ void do_save_state(const std::string& filename, int binary)
 			target.romxml_sha256[i] = xml.sha_256.read();
 			target.namehint[i] = img.namehint;
 		}
-		target.dyn.savestate = core.rom->save_core_state();
+		//The checksum is computed by the writer if saving in background.
+		core.rom->save_core_state(target.dyn.savestate, async);
 		core.fbuf->get_framebuffer().save(target.dyn.screenshot);
 		core.mlogic->get_movie().save_state(target.projectid, target.dyn.save_frame,
 			target.dyn.lagged_frames, target.dyn.pollcounters);
@@ -246,13 +382,38 @@ void do_save_state(const std::string& filename, int binary)
 			target.authors = prj->authors;
 		}
 		target.dyn.active_macros = core.controls->get_macro_frames();
-		target.save(filename2, SET_savecompression(*core.settings), binary > 0,
-			core.mlogic->get_rrdata(), true);
-		uint64_t took = framerate_regulator::get_utime() - origtime;
-		std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
-		messages << "Saved state " << kind << " '" << filename2 << "' in " << took << " microseconds."
-			<< std::endl;
-		core.lua2->callback_post_save(filename2, true);
+		if(async) {
+			//Freeze copy of the movie, the rest is done by the writer.
+			target.coreversion = target.gametype->get_type().get_core_identifier();
+			pending_save* s = new pending_save;
+			try {
+				s->mv = NULL;
+				core.mlogic->get_rrdata().write(s->rrdata);
+				s->mv = new moviefile;
+				s->mv->copy_fields(target);
+				s->filename = filename2;
+				s->compression = SET_savecompression(*core.settings);
+				s->binary = (binary > 0);
+				s->fast_checksum = core.rom->fast_core_state_checksum();
+				s->start_time = origtime;
+				s->sync_time = framerate_regulator::get_utime() - origtime;
+				state_writer_started = true;
+				get_state_writer().queue(s);
+			} catch(...) {
+				delete s->mv;
+				delete s;
+				throw;
+			}
+		} else {
+			wait_pending_saves();
+			target.save(filename2, SET_savecompression(*core.settings), binary > 0,
+				core.mlogic->get_rrdata(), true);
+			uint64_t took = framerate_regulator::get_utime() - origtime;
+			std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
+			messages << "Saved state " << kind << " '" << filename2 << "' in " << took
+				<< " microseconds." << std::endl;
+			core.lua2->callback_post_save(filename2, true);
+		}
 	} catch(std::bad_alloc& e) {
 		throw;
 	} catch(std::exception& e) {
@@ -268,6 +429,15 @@ void do_save_state(const std::string& filename, int binary)
 	}
 }
 
+void wait_pending_saves()
+{
+	if(!state_writer_started)
+		return;
+	auto& w = get_state_writer();
+	w.wait_busy();
+	w.reap();
+}
+
 //Save movie.
 void do_save_movie(const std::string& filename, int binary)
 {
@@ -279,6 +449,7 @@ void do_save_movie(const std::string& filename, int binary)
 	}
 	auto& target = core.mlogic->get_mfile();
 	std::string filename2 = translate_name_mprefix(filename, binary, 0);
+	wait_pending_saves();
 	core.lua2->callback_pre_save(filename2, false);
 	try {
 		uint64_t origtime = framerate_regulator::get_utime();
@@ -851,6 +1022,8 @@ bool do_load_state(const std::string& filename, int lmode)
 	auto& core = CORE();
 	int tmp = -1;
 	std::string filename2 = translate_name_mprefix(filename, tmp, -1);
+	//The state to load might still be being written.
+	wait_pending_saves();
 	uint64_t origtime = framerate_regulator::get_utime();
 	core.lua2->callback_pre_load(filename2);
 	struct moviefile* mfile = NULL;
@@ -0,0 +1,213 @@
+#include "core/command.hpp"
+#include "core/controllerframe.hpp"
+#include "core/dispatch.hpp"
+#include "core/framerate.hpp"
+#include "core/instance.hpp"
+#include "core/keymapper.hpp"
+#include "core/messages.hpp"
+#include "core/moviedata.hpp"
+#include "core/rewind.hpp"
+#include "core/rom.hpp"
+#include "core/runmode.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "library/rewindbuf.hpp"
+#include "lua/lua.hpp"
+
+#include <deque>
+
+namespace
+{
+	settingvar::supervariable<settingvar::model_int<0,65535>> SET_rewind_buffer(lsnes_setgrp, "rewind-buffer",
+		"Movie‣Rewind‣Buffer size (MB)", 0);
+	settingvar::supervariable<settingvar::model_int<1,3600>> SET_rewind_interval(lsnes_setgrp,
+		"rewind-interval", "Movie‣Rewind‣Capture interval (frames)", 1);
+	settingvar::supervariable<settingvar::model_int<1,65535>> SET_rewind_keyframe(lsnes_setgrp,
+		"rewind-keyframe", "Movie‣Rewind‣Keyframe interval (captures)", 64);
+
+	//Movie state corresponding to rewind point.
+	struct rewind_point
+	{
+		uint64_t frame;
+		uint64_t ptr;
+		uint64_t lagged_frames;
+		std::vector<uint32_t> pollcounters;
+		unsigned poll_flag;
+		int64_t rtc_second;
+		int64_t rtc_subsecond;
+		std::map<std::string, uint64_t> active_macros;
+	};
+
+	rewind_buffer buffer(0, 1);
+	std::deque<rewind_point> points;
+	std::vector<char> scratch;
+	bool rewind_held = false;
+	bool rewind_seen = false;
+	bool was_paused = false;
+	uint64_t frames_since_capture = 0;
+	//Statistics.
+	uint64_t last_raw_size = 0;
+	uint64_t capture_count = 0;
+	uint64_t capture_bytes = 0;
+	uint64_t capture_time = 0;
+	uint64_t last_capture_time = 0;
+	uint64_t restore_count = 0;
+	uint64_t restore_time = 0;
+	uint64_t last_restore_time = 0;
+
+	size_t budget_bytes()
+	{
+		return (size_t)SET_rewind_buffer(*CORE().settings) << 20;
+	}
+
+	void drop_points(size_t count)
+	{
+		while(count--)
+			points.pop_front();
+	}
+
+	command::fnptr<> CMD_rewind_press(lsnes_cmds, "+rewind", "Rewind",
+		"Syntax: +rewind\nRewinds emulation while held (requires rewind-buffer to be set).\n",
+		[]() {
+			auto& core = CORE();
+			if(rewind_held)
+				return;
+			rewind_held = true;
+			rewind_seen = false;
+			//Rewinding needs the emulation to be running.
+			was_paused = core.runmode->is_paused_normal();
+			if(was_paused && !core.runmode->is_special()) {
+				core.runmode->set_freerunning();
+				platform::set_paused(false);
+				platform::cancel_wait();
+			}
+		});
+
+	command::fnptr<> CMD_rewind_release(lsnes_cmds, "-rewind", "Rewind",
+		"No help available\n",
+		[]() {
+			auto& core = CORE();
+			rewind_held = false;
+			if(was_paused && core.runmode->is_freerunning()) {
+				core.runmode->set_pause();
+				platform::cancel_wait();
+			}
+			was_paused = false;
+		});
+
+	command::fnptr<> CMD_rewind_status(lsnes_cmds, "rewind-status", "Show rewind buffer status",
+		"Syntax: rewind-status\nShow rewind buffer usage and timing statistics.\n",
+		[]() {
+			messages << "Rewind buffer: " << points.size() << " point(s), " << buffer.memory_usage()
+				<< "/" << budget_bytes() << " bytes used" << std::endl;
+			messages << "Last snapshot: " << last_raw_size << " bytes raw, "
+				<< buffer.last_encoded_size() << " bytes encoded" << std::endl;
+			if(capture_count)
+				messages << "Capture: " << capture_bytes / capture_count << " bytes/snapshot average, "
+					<< capture_time / capture_count << " usec average, " << last_capture_time
+					<< " usec last" << std::endl;
+			if(restore_count)
+				messages << "Restore: " << restore_time / restore_count << " usec average, "
+					<< last_restore_time << " usec last" << std::endl;
+		});
+
+	command::fnptr<> CMD_rewind_clear(lsnes_cmds, "rewind-clear", "Clear rewind buffer",
+		"Syntax: rewind-clear\nDiscard all rewind points.\n",
+		[]() {
+			rewind_clear();
+			messages << "Rewind buffer cleared" << std::endl;
+		});
+
+	keyboard::invbind_info IBIND_irewind(lsnes_invbinds, "+rewind", "Movie‣Rewind");
+}
+
+bool rewind_capture_due()
+{
+	auto& core = CORE();
+	if(rewind_held || !SET_rewind_buffer(*core.settings))
+		return false;
+	return ++frames_since_capture >= (uint64_t)SET_rewind_interval(*core.settings);
+}
+
+void rewind_capture()
+{
+	auto& core = CORE();
+	if(!*core.mlogic)
+		return;
+	frames_since_capture = 0;
+	uint64_t t = framerate_regulator::get_utime();
+	drop_points(buffer.set_limits(budget_bytes(), SET_rewind_keyframe(*core.settings)));
+
+	rewind_point p;
+	core.mlogic->get_movie().fast_save(p.frame, p.ptr, p.lagged_frames, p.pollcounters);
+	auto& dyn = core.mlogic->get_mfile().dyn;
+	p.poll_flag = core.rom->get_pflag();
+	p.rtc_second = dyn.rtc_second;
+	p.rtc_subsecond = dyn.rtc_subsecond;
+	p.active_macros = core.controls->get_macro_frames();
+	core.rom->save_core_state(scratch, true);
+	points.push_back(p);
+	try {
+		drop_points(buffer.push(&scratch[0], scratch.size()));
+	} catch(...) {
+		points.pop_back();
+		throw;
+	}
+
+	last_raw_size = scratch.size();
+	last_capture_time = framerate_regulator::get_utime() - t;
+	capture_count++;
+	capture_bytes += buffer.last_encoded_size();
+	capture_time += last_capture_time;
+}
+
+bool rewind_requested()
+{
+	return rewind_held;
+}
+
+bool rewind_restore()
+{
+	auto& core = CORE();
+	uint64_t t = framerate_regulator::get_utime();
+	if(!*core.mlogic || !buffer.pop(scratch))
+		return false;
+	rewind_point p = points.back();
+	points.pop_back();
+	auto& mov = core.mlogic->get_movie();
+	bool ro = mov.readonly_mode();
+	if(!rewind_seen) {
+		//Count one rerecord per rewind, not per rewound frame.
+		if(!ro)
+			core.lua2->callback_movie_lost("rewind");
+		core.mlogic->get_rrdata().read_base(rrdata::filename(core.mlogic->get_mfile().projectid),
+			false);
+		core.mlogic->get_rrdata().add((*core.nrrdata)());
+		rewind_seen = true;
+	}
+	core.rom->load_core_state(scratch, true);
+	core.rom->set_pflag(p.poll_flag);
+	core.controls->set_macro_frames(p.active_macros);
+	mov.fast_load(p.frame, p.ptr, p.lagged_frames, p.pollcounters, ro);
+	auto& dyn = core.mlogic->get_mfile().dyn;
+	dyn.save_frame = p.frame;
+	dyn.lagged_frames = p.lagged_frames;
+	dyn.pollcounters = p.pollcounters;
+	dyn.poll_flag = p.poll_flag;
+	dyn.rtc_second = p.rtc_second;
+	dyn.rtc_subsecond = p.rtc_subsecond;
+	dyn.active_macros = p.active_macros;
+	frames_since_capture = 0;
+
+	last_restore_time = framerate_regulator::get_utime() - t;
+	restore_count++;
+	restore_time += last_restore_time;
+	return true;
+}
+
+void rewind_clear()
+{
+	buffer.clear();
+	points.clear();
+	frames_since_capture = 0;
+}
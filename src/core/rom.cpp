@@ -13,6 +13,7 @@
 #include "interface/callbacks.hpp"
 #include "interface/cover.hpp"
 #include "interface/romtype.hpp"
+#include "library/arch-detect.hpp"
 #include "library/portctrl-data.hpp"
 #include "library/fileimage-patch.hpp"
 #include "library/sha256.hpp"
@@ -41,6 +42,62 @@ namespace
 {
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> savestate_no_check(lsnes_setgrp,
 		"dont-check-savestate", "Movie‣Loading‣Don't check savestates", false);
+	settingvar::enumeration state_checksums {"sha256", "fast"};
+	settingvar::supervariable<settingvar::model_enumerated<&state_checksums>> savestate_checksum(lsnes_setgrp,
+		"savestate-checksum", "Movie‣Saving‣Savestate checksum", 0);
+
+	//Savestates with fast checksum end in 64-bit checksum followed by this tag, in place of the SHA-256.
+	const char fast_checksum_tag[24] = "LSNES-FAST-CHECKSUM-V1\0";
+
+	const uint64_t fc_prime1 = 0x9E3779B185EBCA87ULL;
+	const uint64_t fc_prime2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64_t fc_prime3 = 0x165667B19E3779F9ULL;
+
+	inline uint64_t fc_rotl(uint64_t x, unsigned r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+
+	inline uint64_t fc_load(const uint8_t* p)
+	{
+#ifdef ARCH_IS_I386
+		uint64_t x;
+		memcpy(&x, p, 8);
+		return x;
+#else
+		uint64_t x = 0;
+		for(unsigned i = 0; i < 8; i++)
+			x |= static_cast<uint64_t>(p[i]) << (8 * i);
+		return x;
+#endif
+	}
+
+	inline uint64_t fc_lane(uint64_t acc, uint64_t in)
+	{
+		return fc_rotl(acc + in * fc_prime2, 31) * fc_prime1;
+	}
+
+	//Non-cryptographic 64-bit checksum, processes four independent lanes to keep the multipliers busy.
+	uint64_t fast_checksum(const char* _data, size_t size)
+	{
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(_data);
+		uint64_t v[4] = {fc_prime1 + fc_prime2, fc_prime2, 0, -fc_prime1};
+		size_t i = 0;
+		for(; i + 32 <= size; i += 32)
+			for(unsigned j = 0; j < 4; j++)
+				v[j] = fc_lane(v[j], fc_load(data + i + 8 * j));
+		uint64_t h = fc_rotl(v[0], 1) + fc_rotl(v[1], 7) + fc_rotl(v[2], 12) + fc_rotl(v[3], 18);
+		for(unsigned j = 0; j < 4; j++)
+			h = (h ^ fc_lane(0, v[j])) * fc_prime1 + fc_prime3;
+		for(; i + 8 <= size; i += 8)
+			h = fc_rotl(h ^ fc_lane(0, fc_load(data + i)), 27) * fc_prime1 + fc_prime3;
+		for(; i < size; i++)
+			h = fc_rotl(h ^ (data[i] * fc_prime3), 11) * fc_prime1;
+		h ^= size;
+		h = (h ^ (h >> 33)) * fc_prime2;
+		h = (h ^ (h >> 29)) * fc_prime3;
+		return h ^ (h >> 32);
+	}
 
 	core_type* current_rom_type = &get_null_type();
 	core_region* current_region = &get_null_region();
@@ -147,19 +204,43 @@ std::map<std::string, std::vector<char>> load_sram_commandline(const std::vector
 std::vector<char> loaded_rom::save_core_state(bool nochecksum)
 {
 	std::vector<char> ret;
-	rtype().serialize(ret);
-	if(nochecksum)
-		return ret;
-	size_t offset = ret.size();
+	save_core_state(ret, nochecksum);
+	return ret;
+}
+
+void loaded_rom::save_core_state(std::vector<char>& out, bool nochecksum)
+{
+	out.clear();
+	rtype().serialize(out);
+	if(!nochecksum)
+		append_core_state_checksum(out, fast_core_state_checksum());
+}
+
+bool loaded_rom::fast_core_state_checksum()
+{
+	return (savestate_checksum(*CORE().settings) == 1);
+}
+
+void loaded_rom::append_core_state_checksum(std::vector<char>& state, bool fast)
+{
+	size_t offset = state.size();
 	unsigned char tmp[32];
+	if(fast) {
+		uint64_t h = fast_checksum(&state[0], offset);
+		for(unsigned i = 0; i < 8; i++)
+			tmp[i] = h >> (8 * i);
+		memcpy(tmp + 8, fast_checksum_tag, 24);
+		state.resize(offset + 32);
+		memcpy(&state[offset], tmp, 32);
+		return;
+	}
 #ifdef USE_LIBGCRYPT_SHA256
-	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &ret[0], offset);
+	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &state[0], offset);
 #else
-	sha256::hash(tmp, ret);
+	sha256::hash(tmp, state);
 #endif
-	ret.resize(offset + 32);
-	memcpy(&ret[offset], tmp, 32);
-	return ret;
+	state.resize(offset + 32);
+	memcpy(&state[offset], tmp, 32);
 }
 
 void loaded_rom::load_core_state(const std::vector<char>& buf, bool nochecksum)
@@ -173,6 +254,16 @@ void loaded_rom::load_core_state(const std::vector<char>& buf, bool nochecksum)
 		throw std::runtime_error("Savestate corrupt");
 	if(!savestate_no_check(*CORE().settings)) {
 		unsigned char tmp[32];
+		//The kind of checksum is recorded in the state, so states can be loaded whatever is selected now.
+		if(!memcmp(&buf[buf.size() - 24], fast_checksum_tag, 24)) {
+			uint64_t h = fast_checksum(&buf[0], buf.size() - 32);
+			for(unsigned i = 0; i < 8; i++)
+				tmp[i] = h >> (8 * i);
+			if(memcmp(tmp, &buf[buf.size() - 32], 8))
+				throw std::runtime_error("Savestate corrupt");
+			rtype().unserialize(&buf[0], buf.size() - 32);
+			return;
+		}
 #ifdef USE_LIBGCRYPT_SHA256
 		gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &buf[0], buf.size() - 32);
 #else
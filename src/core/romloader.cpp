@@ -6,6 +6,7 @@
 #include "core/rom.hpp"
 #include "core/settings.hpp"
 #include "core/window.hpp"
+#include "library/directory.hpp"
 #include "library/zip.hpp"
 
 bool load_null_rom()
@@ -50,6 +51,19 @@ namespace
 		}
 	}
 
+	//Command line option (without the leading --) that specifies ROM slot i.
+	std::string slot_option(core_type& t, unsigned i)
+	{
+		bool bios = (t.get_biosname() != "");
+		if(i == 0 && bios)
+			return "bios";
+		char j[2] = {0, 0};
+		j[0] = i - (bios ? 1 : 0) + 'a';
+		if(j[0] == 'a' + 26)
+			j[0] = '@';
+		return std::string("rom-") + j;
+	}
+
 	std::string call_rom(unsigned i, bool bios)
 	{
 		if(i == 0 && bios)
@@ -143,6 +157,30 @@ bool reload_active_rom()
 	return _load_new_rom(req);
 }
 
+std::vector<std::string> active_rom_arguments()
+{
+	auto& core = CORE();
+	std::vector<std::string> args;
+	if(core.rom->isnull())
+		return args;
+	core_type& ctype = core.rom->get_internal_rom_type();
+	args.push_back("--core=" + ctype.get_core_shortname());
+	//Cores may load further firmware by themselves.
+	args.push_back("--setting-firmwarepath=" + SET_firmwarepath(*core.settings));
+	//Single-file ROM?
+	std::string loadfile = core.rom->get_pack_filename();
+	if(loadfile != "") {
+		args.push_back("--rom=" + directory::absolute_path(loadfile));
+		return args;
+	}
+	for(unsigned i = 0; i < ctype.get_image_count(); i++) {
+		const std::string& filename = core.rom->get_rom(i).filename;
+		if(filename != "")
+			args.push_back("--" + slot_option(ctype, i) + "=" + directory::absolute_path(filename));
+	}
+	return args;
+}
+
 regex_results get_argument(const std::vector<std::string>& cmdline, const std::string& regexp)
 {
 	for(auto i : cmdline) {
@@ -175,17 +213,13 @@ rom_image_handle construct_rom_multifile(core_type* ctype, const moviefile::brie
 		bool isbios = false;
 		auto psetting = &SET_firmwarepath;
 		std::string romid;
+		optregex = "--" + slot_option(*ctype, i) + "=(.*)";
 		if(bios != "" && i == 0) {
-			optregex = "--bios=(.*)";
 			isbios = true;
 			psetting = &SET_firmwarepath;
 			romid = "BIOS";
 		} else {
 			char j[2] = {0, 0};
-			j[0] = i - ((bios != "") ? 1 : 0) + 'a';
-			if(j[0] == 'a' + 26)
-				j[0] = '@';
-			optregex = std::string("--rom-") + j + "=(.*)";
 			psetting = &SET_rompath;
 			j[0] = i - ((bios != "") ? 1 : 0) + 'A';
 			if(j[0] == 'A' + 26)
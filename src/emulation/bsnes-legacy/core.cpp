@@ -1222,8 +1222,7 @@ namespace
 			if(!internal_rom)
 				throw std::runtime_error("No ROM loaded");
 			serializer s = SNES::system.serialize();
-			out.resize(s.size());
-			memcpy(&out[0], s.data(), s.size());
+			out.assign(s.data(), s.data() + s.size());
 		}
 		void c_unserialize(const char* in, size_t insize) {
 			if(!internal_rom)
@@ -31,6 +31,7 @@ namespace sky
 			mplayer(state.music, state.rng)
 		{
 			memset(samplectr, 0, sizeof(samplectr));
+			skip_render = false;
 		}
 		gstate state;
 		song_buffer* bsong;
@@ -52,6 +53,7 @@ namespace sky
 		struct pipe_cache pipecache[7];
 		uint32_t fadeffect_buffer[FB_WIDTH * FB_HEIGHT];
 		bool indirect_flag;
+		bool skip_render;
 		uint32_t origbuffer[65536];
 		uint32_t framebuffer[FB_WIDTH * FB_HEIGHT];
 		uint16_t overlap_start;
@@ -320,7 +320,9 @@ namespace sky
 		uint8_t death = inst.state.simulate_frame(inst.gsfx, lr, ad, jump);
 		if(!inst.state.p.death && inst.state.waited < 65535)
 			inst.state.waited++;
-		draw_level(inst);
+		//The level view is redrawn from scratch each frame, so it can be skipped if frame isn't shown.
+		if(!inst.skip_render)
+			draw_level(inst);
 		if(inst.state.timeattack)
 			draw_timeattack_time(inst, inst.state.waited);
 		draw_gauges(inst);
@@ -282,8 +282,7 @@ namespace sky
 		}
 		void c_serialize(std::vector<char>& out) {
 			auto wram = corei.state.as_ram();
-			out.resize(wram.second);
-			memcpy(&out[0], wram.first, wram.second);
+			out.assign(wram.first, wram.first + wram.second);
 		}
 		void c_unserialize(const char* in, size_t insize) {
 			auto wram = corei.state.as_ram();
@@ -334,6 +333,7 @@ namespace sky
 		void c_runtosave() {}
 		bool c_get_pflag() { return pflag; }
 		void c_set_pflag(bool _pflag) { pflag = _pflag; }
+		bool c_set_render(bool enable) { corei.skip_render = !enable; return true; }
 		framebuffer::raw& c_draw_cover() {
 			static framebuffer::raw x(cover_fbinfo);
 			return x;
@@ -52,6 +52,7 @@ template<> int ccore_call_param_map<lsnes_core_pre_emulate>::id = LSNES_CORE_PRE
 template<> int ccore_call_param_map<lsnes_core_get_device_regs>::id = LSNES_CORE_GET_DEVICE_REGS;
 template<> int ccore_call_param_map<lsnes_core_get_vma_list>::id = LSNES_CORE_GET_VMA_LIST;
 template<> int ccore_call_param_map<lsnes_core_reinit>::id = LSNES_CORE_REINIT;
+template<> int ccore_call_param_map<lsnes_core_set_render>::id = LSNES_CORE_SET_RENDER;
 
 template<> const char* ccore_call_param_map<lsnes_core_enumerate_cores>::name = "LSNES_CORE_ENUMERATE_CORES";
 template<> const char* ccore_call_param_map<lsnes_core_get_core_info>::name = "LSNES_CORE_GET_CORE_INFO";
@@ -89,6 +90,7 @@ template<> const char* ccore_call_param_map<lsnes_core_pre_emulate>::name = "LSN
 template<> const char* ccore_call_param_map<lsnes_core_get_device_regs>::name = "LSNES_CORE_GET_DEVICE_REGS";
 template<> const char* ccore_call_param_map<lsnes_core_get_vma_list>::name = "LSNES_CORE_GET_VMA_LIST";
 template<> const char* ccore_call_param_map<lsnes_core_reinit>::name = "LSNES_CORE_REINIT";
+template<> const char* ccore_call_param_map<lsnes_core_set_render>::name = "LSNES_CORE_SET_RENDER";
 
 namespace
 {
@@ -291,6 +293,12 @@ namespace
 			if(caps1 & (LSNES_CORE_CAP1_DEBUG | LSNES_CORE_CAP1_TRACE | LSNES_CORE_CAP1_CHEAT))
 				entrypoint(id, s);
 		}
+		bool c_set_render(bool enable)
+		{
+			lsnes_core_set_render s;
+			s.enable = enable ? 1 : 0;
+			return (caps1 & LSNES_CORE_CAP1_RENDERSKIP) && entrypoint(id, s);
+		}
 		std::pair<unsigned, unsigned> c_lightgun_scale()
 		{
 			lsnes_core_get_av_state s;
@@ -418,8 +426,7 @@ namespace
 			entrypoint(id, s, [](const char* name, const char* err) {
 				throw std::runtime_error("Savestate failed: " + std::string(err));
 			});
-			out.resize(s.size);
-			memcpy(&out[0], s.data, s.size);
+			out.assign(s.data, s.data + s.size);
 		}
 		unsigned c_action_flags(unsigned _id)
 		{
@@ -320,6 +320,16 @@ std::pair<unsigned, unsigned> core_core::c_lightgun_scale()
 	return std::make_pair(0, 0);
 }
 
+bool core_core::set_render(bool enable)
+{
+	return c_set_render(enable);
+}
+
+bool core_core::c_set_render(bool enable)
+{
+	return false;
+}
+
 void core_core::debug_reset()
 {
 	return c_debug_reset();
@@ -381,6 +391,7 @@ core_core::core_core(std::initializer_list<portctrl::type*> ports, std::initiali
 		actions[i._symbol] = i;
 
 	hidden = false;
+	last_state_size = 0;
 	uninitialized_cores_set().insert(this);
 	all_cores_set().insert(this);
 	new_core_flag = true;
@@ -395,6 +406,7 @@ core_core::core_core(std::vector<portctrl::type*> ports, std::vector<interface_a
 		actions[i._symbol] = i;
 
 	hidden = false;
+	last_state_size = 0;
 	uninitialized_cores_set().insert(this);
 	all_cores_set().insert(this);
 	new_core_flag = true;
@@ -470,7 +482,10 @@ void core_core::load_sram(std::map<std::string, std::vector<char>>& sram)
 
 void core_core::serialize(std::vector<char>& out)
 {
+	//Make room for state of the same size as last time plus the checksum, so reused buffers don't need to grow.
+	out.reserve(last_state_size + 64);
 	c_serialize(out);
+	last_state_size = out.size();
 }
 
 void core_core::unserialize(const char* in, size_t insize)
@@ -0,0 +1,61 @@
+#include "cpu-features.hpp"
+#include "arch-detect.hpp"
+#include <cstdint>
+#include <cstdlib>
+#ifdef ARCH_IS_I386
+#include <cpuid.h>
+#endif
+
+namespace cpu_features
+{
+namespace
+{
+	enum
+	{
+		F_SSE2 = 1,
+		F_SSSE3 = 2,
+		F_SSE41 = 4,
+		F_AVX2 = 8,
+		F_SHA = 16,
+	};
+
+	uint32_t detect()
+	{
+		uint32_t f = 0;
+#ifdef ARCH_IS_I386
+		unsigned a, b, c, d;
+		if(!__get_cpuid(1, &a, &b, &c, &d))
+			return f;
+		if(d & (1U << 26)) f |= F_SSE2;
+		if(c & (1U << 9)) f |= F_SSSE3;
+		if(c & (1U << 19)) f |= F_SSE41;
+		//AVX state must be enabled by OS (OSXSAVE and XCR0 bits 1-2).
+		bool ymm_ok = false;
+		if((c & (1U << 27)) && (c & (1U << 28))) {
+			uint32_t xlo, xhi;
+			asm volatile(".byte 0x0f, 0x01, 0xd0" : "=a"(xlo), "=d"(xhi) : "c"(0));
+			ymm_ok = ((xlo & 6) == 6);
+		}
+		if(__get_cpuid_max(0, NULL) >= 7) {
+			__cpuid_count(7, 0, a, b, c, d);
+			if(ymm_ok && (b & (1U << 5))) f |= F_AVX2;
+			if(b & (1U << 29)) f |= F_SHA;
+		}
+#endif
+		return f;
+	}
+
+	inline bool has(uint32_t flag)
+	{
+		//Detected once, thread-safely, on first use.
+		static const uint32_t features = detect();
+		return (features & flag) != 0;
+	}
+}
+
+bool sse2() throw() { return has(F_SSE2); }
+bool ssse3() throw() { return has(F_SSSE3); }
+bool sse41() throw() { return has(F_SSE41); }
+bool avx2() throw() { return has(F_AVX2); }
+bool sha() throw() { return has(F_SHA); }
+}
@@ -1,8 +1,135 @@
 #include "framebuffer-pixfmt-lrgb.hpp"
 #include "framebuffer.hpp"
+#include "arch-detect.hpp"
+#include "cpu-features.hpp"
+
+#ifdef ARCH_HAS_I386_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+namespace lrgb_sse2
+{
+	typedef __m128i vtype;
+	const unsigned vbytes = 16;
+	inline vtype vload(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const vtype*>(p)); }
+	inline void vstore(uint8_t* p, vtype a) { _mm_storeu_si128(reinterpret_cast<vtype*>(p), a); }
+	inline vtype vand(vtype a, vtype b) { return _mm_and_si128(a, b); }
+	inline vtype vadd32(vtype a, vtype b) { return _mm_add_epi32(a, b); }
+	inline vtype vadd64(vtype a, vtype b) { return _mm_add_epi64(a, b); }
+	inline vtype vset16(uint16_t v) { return _mm_set1_epi16((short)v); }
+	inline vtype vset32(uint32_t v) { return _mm_set1_epi32((int)v); }
+	inline vtype vadd16(vtype a, vtype b) { return _mm_add_epi16(a, b); }
+	inline vtype vsub16(vtype a, vtype b) { return _mm_sub_epi16(a, b); }
+	inline vtype vmul16(vtype a, vtype b) { return _mm_mullo_epi16(a, b); }
+	inline vtype vmulhiu16(vtype a, vtype b) { return _mm_mulhi_epu16(a, b); }
+	inline vtype vsll16(vtype a, int s) { return _mm_slli_epi16(a, s); }
+	inline vtype vsrl16(vtype a, int s) { return _mm_srli_epi16(a, s); }
+	inline vtype vsra16(vtype a, int s) { return _mm_srai_epi16(a, s); }
+	inline vtype vsrl32(vtype a, int s) { return _mm_srli_epi32(a, s); }
+	inline vtype vsll32(vtype a, uint8_t s) { return _mm_sll_epi32(a, _mm_cvtsi32_si128(s)); }
+	inline vtype vsll64(vtype a, uint8_t s) { return _mm_sll_epi64(a, _mm_cvtsi32_si128(s)); }
+	inline vtype vpack32(vtype a, vtype b) { return _mm_packs_epi32(a, b); }
+	inline vtype vwiden16lo(vtype a) { return _mm_unpacklo_epi16(a, _mm_setzero_si128()); }
+	inline vtype vwiden16hi(vtype a) { return _mm_unpackhi_epi16(a, _mm_setzero_si128()); }
+	inline vtype vwiden32lo(vtype a) { return _mm_unpacklo_epi32(a, _mm_setzero_si128()); }
+	inline vtype vwiden32hi(vtype a) { return _mm_unpackhi_epi32(a, _mm_setzero_si128()); }
+#include "framebuffer-pixfmt-lrgb-simd.inc"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+namespace lrgb_avx2
+{
+	typedef __m256i vtype;
+	const unsigned vbytes = 32;
+	inline vtype vload(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const vtype*>(p)); }
+	inline void vstore(uint8_t* p, vtype a) { _mm256_storeu_si256(reinterpret_cast<vtype*>(p), a); }
+	inline vtype vand(vtype a, vtype b) { return _mm256_and_si256(a, b); }
+	inline vtype vadd32(vtype a, vtype b) { return _mm256_add_epi32(a, b); }
+	inline vtype vadd64(vtype a, vtype b) { return _mm256_add_epi64(a, b); }
+	inline vtype vset16(uint16_t v) { return _mm256_set1_epi16((short)v); }
+	inline vtype vset32(uint32_t v) { return _mm256_set1_epi32((int)v); }
+	inline vtype vadd16(vtype a, vtype b) { return _mm256_add_epi16(a, b); }
+	inline vtype vsub16(vtype a, vtype b) { return _mm256_sub_epi16(a, b); }
+	inline vtype vmul16(vtype a, vtype b) { return _mm256_mullo_epi16(a, b); }
+	inline vtype vmulhiu16(vtype a, vtype b) { return _mm256_mulhi_epu16(a, b); }
+	inline vtype vsll16(vtype a, int s) { return _mm256_slli_epi16(a, s); }
+	inline vtype vsrl16(vtype a, int s) { return _mm256_srli_epi16(a, s); }
+	inline vtype vsra16(vtype a, int s) { return _mm256_srai_epi16(a, s); }
+	inline vtype vsrl32(vtype a, int s) { return _mm256_srli_epi32(a, s); }
+	inline vtype vsll32(vtype a, uint8_t s) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(s)); }
+	inline vtype vsll64(vtype a, uint8_t s) { return _mm256_sll_epi64(a, _mm_cvtsi32_si128(s)); }
+	//Packing and unpacking work within 128-bit halves, so widening undoes the interleave of vpack32.
+	inline vtype vpack32(vtype a, vtype b) { return _mm256_packs_epi32(a, b); }
+	inline vtype vwiden16lo(vtype a) { return _mm256_unpacklo_epi16(a, _mm256_setzero_si256()); }
+	inline vtype vwiden16hi(vtype a) { return _mm256_unpackhi_epi16(a, _mm256_setzero_si256()); }
+	inline vtype vwiden32lo(vtype a) { return _mm256_cvtepu32_epi64(_mm256_castsi256_si128(a)); }
+	inline vtype vwiden32hi(vtype a) { return _mm256_cvtepu32_epi64(_mm256_extracti128_si256(a, 1)); }
+#include "framebuffer-pixfmt-lrgb-simd.inc"
+}
+#pragma GCC pop_options
+#endif
 
 namespace framebuffer
 {
+namespace
+{
+	//Convert one LRGB pixel to 8 (32-bit) or 16 (64-bit) bits per channel.
+	template<typename T> T convert(uint32_t word, uint8_t rshift, uint8_t gshift, uint8_t bshift)
+	{
+		const unsigned bits = 2 * sizeof(T);
+		T l = 1 + ((word >> 15) & 0xF);
+		T r = l * ((word >> 0) & 0x1F);
+		T g = l * ((word >> 5) & 0x1F);
+		T b = l * ((word >> 10) & 0x1F);
+		T x = (((r << bits) - r + 248) / 496) << rshift;
+		x += (((g << bits) - g + 248) / 496) << gshift;
+		x += (((b << bits) - b + 248) / 496) << bshift;
+		return x;
+	}
+
+	bool have_simd()
+	{
+#ifdef ARCH_HAS_I386_INTRINSICS
+		return cpu_features::sse2();
+#else
+		return false;
+#endif
+	}
+
+	template<bool X> void decode_computed(typename elem<X>::t* target, const uint8_t* src, size_t width,
+		const auxpalette<X>& auxp)
+	{
+		size_t i = 0;
+#ifdef ARCH_HAS_I386_INTRINSICS
+		if(cpu_features::avx2())
+			i = lrgb_avx2::decode(target, src, width, auxp.rshift, auxp.gshift, auxp.bshift);
+		else if(cpu_features::sse2())
+			i = lrgb_sse2::decode(target, src, width, auxp.rshift, auxp.gshift, auxp.bshift);
+#endif
+		const uint32_t* _src = reinterpret_cast<const uint32_t*>(src);
+		for(; i < width; i++)
+			target[i] = convert<typename elem<X>::t>(_src[i], auxp.rshift, auxp.gshift, auxp.bshift);
+	}
+
+	template<bool X> void build_palette(auxpalette<X>& auxp, uint8_t rshift, uint8_t gshift, uint8_t bshift)
+	{
+		if(have_simd()) {
+			//Computed directly in decode, no need for the 512k-entry table.
+			std::vector<typename elem<X>::t>().swap(auxp.pcache);
+		} else {
+			auxp.pcache.resize(0x80000);
+			for(size_t i = 0; i < 0x80000; i++)
+				auxp.pcache[i] = convert<typename elem<X>::t>(i, rshift, gshift, bshift);
+		}
+		auxp.rshift = rshift;
+		auxp.gshift = gshift;
+		auxp.bshift = bshift;
+	}
+}
+
 _pixfmt_lrgb::~_pixfmt_lrgb() throw()
 {
 }
@@ -27,6 +154,10 @@ void _pixfmt_lrgb::decode(uint32_t* target, const uint8_t* src, size_t width)
 void _pixfmt_lrgb::decode(uint32_t* target, const uint8_t* src, size_t width,
 	const auxpalette<false>& auxp) throw()
 {
+	if(auxp.pcache.empty()) {
+		decode_computed(target, src, width, auxp);
+		return;
+	}
 	const uint32_t* _src = reinterpret_cast<const uint32_t*>(src);
 	for(size_t i = 0; i < width; i++)
 		target[i] = auxp.pcache[_src[i] & 0x7FFFF];
@@ -35,6 +166,10 @@ void _pixfmt_lrgb::decode(uint32_t* target, const uint8_t* src, size_t width,
 void _pixfmt_lrgb::decode(uint64_t* target, const uint8_t* src, size_t width,
 	const auxpalette<true>& auxp) throw()
 {
+	if(auxp.pcache.empty()) {
+		decode_computed(target, src, width, auxp);
+		return;
+	}
 	const uint32_t* _src = reinterpret_cast<const uint32_t*>(src);
 	for(size_t i = 0; i < width; i++)
 		target[i] = auxp.pcache[_src[i] & 0x7FFFF];
@@ -43,37 +178,13 @@ void _pixfmt_lrgb::decode(uint64_t* target, const uint8_t* src, size_t width,
 void _pixfmt_lrgb::set_palette(auxpalette<false>& auxp, uint8_t rshift, uint8_t gshift,
 	uint8_t bshift)
 {
-	auxp.pcache.resize(0x80000);
-	for(size_t i = 0; i < 0x80000; i++) {
-		uint32_t l = 1 + ((i >> 15) & 0xF);
-		uint32_t r = l * ((i >> 0) & 0x1F);
-		uint32_t g = l * ((i >> 5) & 0x1F);
-		uint32_t b = l * ((i >> 10) & 0x1F);
-		auxp.pcache[i] = (((r << 8) - r + 248) / 496) << rshift;
-		auxp.pcache[i] += (((g << 8) - g + 248) / 496) << gshift;
-		auxp.pcache[i] += (((b << 8) - b + 248) / 496) << bshift;
-	}
-	auxp.rshift = rshift;
-	auxp.gshift = gshift;
-	auxp.bshift = bshift;
+	build_palette(auxp, rshift, gshift, bshift);
 }
 
 void _pixfmt_lrgb::set_palette(auxpalette<true>& auxp, uint8_t rshift, uint8_t gshift,
 	uint8_t bshift)
 {
-	auxp.pcache.resize(0x80000);
-	for(size_t i = 0; i < 0x80000; i++) {
-		uint64_t l = 1 + ((i >> 15) & 0xF);
-		uint64_t r = l * ((i >> 0) & 0x1F);
-		uint64_t g = l * ((i >> 5) & 0x1F);
-		uint64_t b = l * ((i >> 10) & 0x1F);
-		auxp.pcache[i] = (((r << 16) - r + 248) / 496) << rshift;
-		auxp.pcache[i] += (((g << 16) - g + 248) / 496) << gshift;
-		auxp.pcache[i] += (((b << 16) - b + 248) / 496) << bshift;
-	}
-	auxp.rshift = rshift;
-	auxp.gshift = gshift;
-	auxp.bshift = bshift;
+	build_palette(auxp, rshift, gshift, bshift);
 }
 
 uint8_t _pixfmt_lrgb::get_bpp() throw()
@@ -5,6 +5,8 @@
 #include "string.hpp"
 #include "minmax.hpp"
 #include "utf8.hpp"
+#include "arch-detect.hpp"
+#include "cpu-features.hpp"
 #include <functional>
 #include <cstring>
 #include <iostream>
@@ -13,6 +15,67 @@
 #define TABSTOPS 64
 #define SCREENSHOT_RGB_MAGIC	0x74212536U
 
+#ifdef ARCH_HAS_I386_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+namespace framebuffer_sse2
+{
+	inline __m128i load(const void* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+	inline void store(void* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+	//Replicate each pixel h times. Returns number of input pixels done.
+	template<size_t h> size_t replicate(uint32_t* out, const uint32_t* in, size_t count)
+	{
+		size_t k;
+		for(k = 0; k + 4 <= count; k += 4) {
+			__m128i v = load(in + k);
+			uint32_t* o = out + k * h;
+			if(h == 2) {
+				store(o, _mm_unpacklo_epi32(v, v));
+				store(o + 4, _mm_unpackhi_epi32(v, v));
+			} else if(h == 3) {
+				store(o, _mm_shuffle_epi32(v, 0x40));		//0 0 0 1
+				store(o + 4, _mm_shuffle_epi32(v, 0xA5));	//1 1 2 2
+				store(o + 8, _mm_shuffle_epi32(v, 0xFE));	//2 3 3 3
+			} else if(h == 4) {
+				store(o, _mm_shuffle_epi32(v, 0x00));
+				store(o + 4, _mm_shuffle_epi32(v, 0x55));
+				store(o + 8, _mm_shuffle_epi32(v, 0xAA));
+				store(o + 12, _mm_shuffle_epi32(v, 0xFF));
+			}
+		}
+		return k;
+	}
+
+	template<size_t h> size_t replicate(uint64_t* out, const uint64_t* in, size_t count)
+	{
+		size_t k;
+		for(k = 0; k + 2 <= count; k += 2) {
+			__m128i v = load(in + k);
+			__m128i lo = _mm_unpacklo_epi64(v, v);
+			__m128i hi = _mm_unpackhi_epi64(v, v);
+			uint64_t* o = out + k * h;
+			if(h == 2) {
+				store(o, lo);
+				store(o + 2, hi);
+			} else if(h == 3) {
+				store(o, lo);
+				store(o + 2, v);
+				store(o + 4, hi);
+			} else if(h == 4) {
+				store(o, lo);
+				store(o + 2, lo);
+				store(o + 4, hi);
+				store(o + 6, hi);
+			}
+		}
+		return k;
+	}
+}
+#pragma GCC pop_options
+#endif
+
 namespace framebuffer
 {
 const char* render_page_id = "Render queues";
@@ -36,6 +99,42 @@ namespace
 		return x;
 	}
 
+	template<size_t h, typename T> void replicate(T* out, const T* in, size_t count)
+	{
+		size_t k = 0;
+#ifdef ARCH_HAS_I386_INTRINSICS
+		if(cpu_features::sse2())
+			k = framebuffer_sse2::replicate<h>(out, in, count);
+#endif
+		for(; k < count; k++)
+			for(size_t i = 0; i < h; i++)
+				out[k * h + i] = in[k];
+	}
+
+	//Horizontally scale line of pixels. Common scale factors have their own loops.
+	template<typename T> void scale_line(T* out, const T* in, size_t count, size_t hscale)
+	{
+		switch(hscale) {
+		case 1:
+			memcpy(out, in, sizeof(T) * count);
+			break;
+		case 2:
+			replicate<2>(out, in, count);
+			break;
+		case 3:
+			replicate<3>(out, in, count);
+			break;
+		case 4:
+			replicate<4>(out, in, count);
+			break;
+		default:
+			for(size_t k = 0; k < count; k++)
+				for(size_t i = 0; i < hscale; i++)
+					*(out++) = in[k];
+			break;
+		}
+	}
+
 	template<size_t c> void decode_words(uint8_t* target, const uint8_t* src, size_t srcsize)
 	{
 		if(c == 1 || c == 2 || c == 3 || c == 4)
@@ -395,44 +494,49 @@ void fb<X>::copy_from(raw& scr, size_t hscale, size_t vscale) throw()
 		current_fmt = scr.fmt;
 	}
 
-	for(size_t y = 0; y < height; y++)
-		memset(rowptr(y), 0, sizeof(typename fb<X>::element_t) * width);
-	if(width < offset_x || height < offset_y) {
-		//Just clear the screen.
-		return;
-	}
 	size_t copyable_width = 0, copyable_height = 0;
-	if(hscale)
+	if(hscale && width >= offset_x)
 		copyable_width = (width - offset_x) / hscale;
-	if(vscale)
+	if(vscale && height >= offset_y)
 		copyable_height = (height - offset_y) / vscale;
 	copyable_width = (copyable_width > scr.width) ? scr.width : copyable_width;
 	copyable_height = (copyable_height > scr.height) ? scr.height : copyable_height;
+	if(!copyable_width || !copyable_height)
+		copyable_width = copyable_height = 0;
+	size_t blit_width = copyable_width * hscale;
+	size_t blit_height = copyable_height * vscale;
+
+	//Only clear the parts the image does not cover.
+	for(size_t y = 0; y < height; y++) {
+		typename fb<X>::element_t* row = rowptr(y);
+		if(y < offset_y || y >= offset_y + blit_height)
+			memset(row, 0, sizeof(typename fb<X>::element_t) * width);
+		else {
+			memset(row, 0, sizeof(typename fb<X>::element_t) * offset_x);
+			memset(row + offset_x + blit_width, 0, sizeof(typename fb<X>::element_t) *
+				(width - offset_x - blit_width));
+		}
+	}
 
+	size_t bpp = scr.fmt->get_bpp();
 	for(size_t y = 0; y < copyable_height; y++) {
 		size_t line = y * vscale + offset_y;
 		const uint8_t* sbase = reinterpret_cast<uint8_t*>(scr.addr) + y * scr.stride;
 		typename fb<X>::element_t* ptr = rowptr(line) + offset_x;
-		size_t bpp = scr.fmt->get_bpp();
-		size_t xptr = 0;
-		size_t old_copyable_width = copyable_width;
-		while(copyable_width > DECBUF_SIZE) {
-			scr.fmt->decode(decbuf, sbase + xptr * bpp, DECBUF_SIZE, auxpal);
-			for(size_t k = 0; k < DECBUF_SIZE; k++)
-				for(size_t i = 0; i < hscale; i++)
-					*(ptr++) = decbuf[k];
-			xptr += DECBUF_SIZE;
-			copyable_width -= DECBUF_SIZE;
+		if(hscale == 1) {
+			//No scaling, decode straight to target.
+			scr.fmt->decode(ptr, sbase, copyable_width, auxpal);
+		} else {
+			for(size_t xptr = 0; xptr < copyable_width; xptr += DECBUF_SIZE) {
+				size_t count = min(copyable_width - xptr, (size_t)DECBUF_SIZE);
+				scr.fmt->decode(decbuf, sbase + xptr * bpp, count, auxpal);
+				scale_line(ptr + xptr * hscale, decbuf, count, hscale);
+			}
 		}
-		scr.fmt->decode(decbuf, sbase + xptr * bpp, copyable_width, auxpal);
-		for(size_t k = 0; k < copyable_width; k++)
-			for(size_t i = 0; i < hscale; i++)
-				*(ptr++) = decbuf[k];
-		copyable_width = old_copyable_width;
+		//Vertical scaling copies the finished line.
 		for(size_t j = 1; j < vscale; j++)
-			memcpy(rowptr(line + j) + offset_x, rowptr(line) + offset_x,
-				sizeof(typename fb<X>::element_t) * hscale * copyable_width);
-	};
+			memcpy(rowptr(line + j) + offset_x, ptr, sizeof(typename fb<X>::element_t) * blit_width);
+	}
 }
 
 template<bool X>
@@ -519,9 +623,8 @@ size_t raw::get_height() const throw() { return height; }
 template<bool X> size_t fb<X>::get_origin_x() const throw() { return offset_x; }
 template<bool X> size_t fb<X>::get_origin_y() const throw() { return offset_y; }
 
-void queue::add(struct object& obj)
+void queue::add(struct node* n, struct object& obj)
 {
-	struct node* n = reinterpret_cast<struct node*>(alloc(sizeof(node)));
 	n->obj = &obj;
 	n->next = NULL;
 	n->killed = false;
@@ -565,9 +668,10 @@ void queue::clear() throw()
 			queue_head->obj->~object();
 		queue_head = queue_head->next;
 	}
-	//Release all memory for reuse.
-	memory_allocated = 0;
+	//Release all memory for reuse. The pages themselves are kept for the next frame.
 	pages = 0;
+	page_free = NULL;
+	page_left = 0;
 	queue_tail = NULL;
 }
 
@@ -576,12 +680,15 @@ void* queue::alloc(size_t block)
 	block = (block + 15) / 16 * 16;
 	if(block > RENDER_PAGE_SIZE)
 		throw std::bad_alloc();
-	if(pages == 0 || memory_allocated + block > pages * RENDER_PAGE_SIZE) {
-		memory_allocated = pages * RENDER_PAGE_SIZE;
-		memory[pages++];
+	if(block > page_left) {
+		//Next page, reusing one from earlier frames if there is one.
+		page_free = memory[pages].content;
+		page_left = RENDER_PAGE_SIZE;
+		pages++;
 	}
-	void* mem = memory[memory_allocated / RENDER_PAGE_SIZE].content + (memory_allocated % RENDER_PAGE_SIZE);
-	memory_allocated += block;
+	void* mem = page_free;
+	page_free += block;
+	page_left -= block;
 	return mem;
 }
 
@@ -608,8 +715,9 @@ queue::queue() throw()
 {
 	queue_head = NULL;
 	queue_tail = NULL;
-	memory_allocated = 0;
 	pages = 0;
+	page_free = NULL;
+	page_left = 0;
 }
 
 queue::~queue() throw()
@@ -776,13 +776,13 @@ namespace
 			}
 			throw error(error::INTERNAL, "Internal error (shouldn't be here)");
 		}
-		static expr_val op_lnot(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_lnot(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 1)
 				throw error(error::ARGCOUNT, "logical not takes 1 argument");
 			return expr_val(boolean_tag(), !(promises[0]().toboolean()));
 		}
-		static expr_val op_lor(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_lor(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "logical or takes 2 arguments");
@@ -790,7 +790,7 @@ namespace
 				return expr_val(boolean_tag(), true);
 			return expr_val(boolean_tag(), promises[1]().toboolean());
 		}
-		static expr_val op_land(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_land(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "logical and takes 2 arguments");
@@ -798,7 +798,7 @@ namespace
 				return expr_val(boolean_tag(), false);
 			return expr_val(boolean_tag(), promises[1]().toboolean());
 		}
-		static expr_val fun_if(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_if(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() == 2) {
 				if((promises[0]().toboolean()))
@@ -813,7 +813,7 @@ namespace
 			} else
 				throw error(error::ARGCOUNT, "if takes 2 or 3 arguments");
 		}
-		static expr_val fun_select(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_select(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			for(auto& i : promises) {
 				expr_val v = i();
@@ -822,7 +822,7 @@ namespace
 			}
 			return expr_val(boolean_tag(), false);
 		}
-		static expr_val fun_pyth(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_pyth(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			std::vector<expr_val> v;
 			for(auto& i : promises)
@@ -837,7 +837,7 @@ namespace
 			return n.sqrt();
 		}
 		template<expr_val (*T)(expr_val& a, expr_val& b)>
-		static expr_val fun_fold(std::vector<std::function<expr_val&()>> promises)
+		static expr_val fun_fold(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(!promises.size())
 				return expr_val(boolean_tag(), false);
@@ -873,7 +873,7 @@ namespace
 			return mul(a, b);
 		}
 		template<expr_val (*T)(expr_val a, expr_val b)>
-		static expr_val op_binary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_binary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 2)
 				throw error(error::ARGCOUNT, "Operation takes 2 arguments");
@@ -881,8 +881,29 @@ namespace
 			expr_val b = promises[1]();
 			return T(a, b);
 		}
+		//Strict forms of the above, for operands that are already evaluated.
+		static expr_val sop_lnot(void* const* operands, size_t count)
+		{
+			if(count != 1)
+				throw error(error::ARGCOUNT, "logical not takes 1 argument");
+			return expr_val(boolean_tag(), !((expr_val*)operands[0])->toboolean());
+		}
+		template<expr_val (*T)(expr_val a, expr_val b)>
+		static expr_val sop_binary(void* const* operands, size_t count)
+		{
+			if(count != 2)
+				throw error(error::ARGCOUNT, "Operation takes 2 arguments");
+			return T(*(expr_val*)operands[0], *(expr_val*)operands[1]);
+		}
+		template<expr_val (*T)(expr_val a)>
+		static expr_val sop_unary(void* const* operands, size_t count)
+		{
+			if(count != 1)
+				throw error(error::ARGCOUNT, "Operation takes 1 argument");
+			return T(*(expr_val*)operands[0]);
+		}
 		template<expr_val (*T)(expr_val a)>
-		static expr_val op_unary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_unary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() != 1)
 				throw error(error::ARGCOUNT, "Operation takes 1 argument");
@@ -890,7 +911,7 @@ namespace
 			return T(a);
 		}
 		template<expr_val (*T)(expr_val a),expr_val (*U)(expr_val a, expr_val b)>
-		static expr_val op_unary_binary(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_unary_binary(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			if(promises.size() == 1)
 				return T(promises[0]());
@@ -936,7 +957,7 @@ namespace
 		{
 			return expr_val_numeric::shift(a.as_numeric(), b.as_numeric(), true);
 		}
-		static expr_val op_pi(std::vector<std::function<expr_val&()>> promises)
+		static expr_val op_pi(const std::vector<std::function<expr_val&()>>& promises)
 		{
 			return expr_val_numeric::op_pi();
 		}
@@ -1046,25 +1067,44 @@ namespace
 		static std::set<operinfo*> operations()
 		{
 			static operinfo_set<expr_val> x({
-				{"-", expr_val::op_unary<expr_val::neg>, true, 1, -3, true},
-				{"!", expr_val::op_lnot, true, 1, -3, true},
-				{"~", expr_val::op_unary<expr_val::bnot>, true, 1, -3, true},
-				{"*", expr_val::op_binary<expr_val::mul>, true, 2, -5, false},
-				{"/", expr_val::op_binary<expr_val::div>, true, 2, -5, false},
-				{"%", expr_val::op_binary<expr_val::rem>, true, 2, -5, false},
-				{"+", expr_val::op_binary<expr_val::add>, true, 2, -6, false},
-				{"-", expr_val::op_binary<expr_val::sub>, true, 2, -6, false},
-				{"<<", expr_val::op_binary<expr_val::lshift>, true, 2, -7, false},
-				{">>", expr_val::op_binary<expr_val::rshift>, true, 2, -7, false},
-				{"<", expr_val::op_binary<expr_val::lt>, true, 2, -8, false},
-				{"<=", expr_val::op_binary<expr_val::le>, true, 2, -8, false},
-				{">", expr_val::op_binary<expr_val::gt>, true, 2, -8, false},
-				{">=", expr_val::op_binary<expr_val::ge>, true, 2, -8, false},
-				{"==", expr_val::op_binary<expr_val::eq>, true, 2, -9, false},
-				{"!=", expr_val::op_binary<expr_val::ne>, true, 2, -9, false},
-				{"&", expr_val::op_binary<expr_val::band>, true, 2, -10, false},
-				{"^", expr_val::op_binary<expr_val::bxor>, true, 2, -11, false},
-				{"|", expr_val::op_binary<expr_val::bor>, true, 2, -12, false},
+				{"-", expr_val::op_unary<expr_val::neg>, true, 1, -3, true,
+					expr_val::sop_unary<expr_val::neg>},
+				{"!", expr_val::op_lnot, true, 1, -3, true,
+					expr_val::sop_lnot},
+				{"~", expr_val::op_unary<expr_val::bnot>, true, 1, -3, true,
+					expr_val::sop_unary<expr_val::bnot>},
+				{"*", expr_val::op_binary<expr_val::mul>, true, 2, -5, false,
+					expr_val::sop_binary<expr_val::mul>},
+				{"/", expr_val::op_binary<expr_val::div>, true, 2, -5, false,
+					expr_val::sop_binary<expr_val::div>},
+				{"%", expr_val::op_binary<expr_val::rem>, true, 2, -5, false,
+					expr_val::sop_binary<expr_val::rem>},
+				{"+", expr_val::op_binary<expr_val::add>, true, 2, -6, false,
+					expr_val::sop_binary<expr_val::add>},
+				{"-", expr_val::op_binary<expr_val::sub>, true, 2, -6, false,
+					expr_val::sop_binary<expr_val::sub>},
+				{"<<", expr_val::op_binary<expr_val::lshift>, true, 2, -7, false,
+					expr_val::sop_binary<expr_val::lshift>},
+				{">>", expr_val::op_binary<expr_val::rshift>, true, 2, -7, false,
+					expr_val::sop_binary<expr_val::rshift>},
+				{"<", expr_val::op_binary<expr_val::lt>, true, 2, -8, false,
+					expr_val::sop_binary<expr_val::lt>},
+				{"<=", expr_val::op_binary<expr_val::le>, true, 2, -8, false,
+					expr_val::sop_binary<expr_val::le>},
+				{">", expr_val::op_binary<expr_val::gt>, true, 2, -8, false,
+					expr_val::sop_binary<expr_val::gt>},
+				{">=", expr_val::op_binary<expr_val::ge>, true, 2, -8, false,
+					expr_val::sop_binary<expr_val::ge>},
+				{"==", expr_val::op_binary<expr_val::eq>, true, 2, -9, false,
+					expr_val::sop_binary<expr_val::eq>},
+				{"!=", expr_val::op_binary<expr_val::ne>, true, 2, -9, false,
+					expr_val::sop_binary<expr_val::ne>},
+				{"&", expr_val::op_binary<expr_val::band>, true, 2, -10, false,
+					expr_val::sop_binary<expr_val::band>},
+				{"^", expr_val::op_binary<expr_val::bxor>, true, 2, -11, false,
+					expr_val::sop_binary<expr_val::bxor>},
+				{"|", expr_val::op_binary<expr_val::bor>, true, 2, -12, false,
+					expr_val::sop_binary<expr_val::bor>},
 				{"&&", expr_val::op_land, true, 2, -13, false},
 				{"||", expr_val::op_lor, true, 2, -14, false},
 				{"π", expr_val::op_pi, true, 0, 0, false},
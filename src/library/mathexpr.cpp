@@ -3,6 +3,7 @@
 #include <functional>
 #include <set>
 #include <map>
+#include <sstream>
 
 namespace mathexpr
 {
@@ -18,6 +19,33 @@ operinfo::~operinfo()
 {
 }
 
+bool operinfo::is_pure()
+{
+	return false;
+}
+
+std::string operinfo::share_key()
+{
+	return "";
+}
+
+bool operinfo::is_strict()
+{
+	return false;
+}
+
+void operinfo::evaluate_strict(value target, void* const* operands, size_t count)
+{
+	throw error(error::INTERNAL, "Operation can't be evaluated strictly");
+}
+
+std::string operinfo::identity_key()
+{
+	std::ostringstream x;
+	x << "@" << this;
+	return x.str();
+}
+
 typeinfo::~typeinfo()
 {
 }
@@ -26,6 +54,7 @@ mathexpr::mathexpr(typeinfo* _type)
 	: type(*_type)
 {
 	owns_operator = false;
+	compiled = false;
 	state = UNDEFINED;
 	_value = NULL;
 	fn = (operinfo*)0xDEADBEEF;
@@ -35,6 +64,7 @@ mathexpr::mathexpr(typeinfo* _type, GC::pointer<mathexpr> fwd)
 	: type(*_type)
 {
 	owns_operator = false;
+	compiled = false;
 	state = FORWARD;
 	_value = type.allocate();
 	arguments.push_back(&*fwd);
@@ -45,6 +75,7 @@ mathexpr::mathexpr(value _val)
 	: type(*_val.type)
 {
 	owns_operator = false;
+	compiled = false;
 	state = FIXED;
 	_value = type.copy_allocate(_val._value);
 	fn = NULL;
@@ -54,17 +85,20 @@ mathexpr::mathexpr(typeinfo* _type, const std::string& _val, bool string)
 	: type(*_type)
 {
 	owns_operator = false;
+	compiled = false;
 	state = FIXED;
 	_value = type.parse(_val, string);
 	fn = NULL;
+	fixed_key = (stringfmt() << (string ? "S" : "V") << _val.length() << ":" << _val).str();
 }
 
 mathexpr::mathexpr(typeinfo* _type, operinfo* _fn, std::vector<GC::pointer<mathexpr>> _args, bool _owns_operator)
-	: type(*_type), fn(_fn), owns_operator(_owns_operator)
+	: type(*_type), fn(_fn), compiled(false), owns_operator(_owns_operator)
 {
 	try {
 		for(auto& i : _args)
 			arguments.push_back(&*i);
+		make_promises();
 		_value = type.allocate();
 		state = TO_BE_EVALUATED;
 	} catch(...) {
@@ -95,7 +129,8 @@ void mathexpr::reset()
 }
 
 mathexpr::mathexpr(const mathexpr& m)
-	: state(m.state), type(m.type), fn(m.fn), _error(m._error), arguments(m.arguments)
+	: state(m.state), type(m.type), fn(m.fn), _error(m._error), arguments(m.arguments), promises(m.promises),
+	operand_values(m.operand_values), compiled(false), fixed_key(m.fixed_key)
 {
 	_value = m._value ? type.copy_allocate(m._value) : NULL;
 	if(state == EVALUATING) state = TO_BE_EVALUATED;
@@ -107,6 +142,9 @@ mathexpr& mathexpr::operator=(const mathexpr& m)
 		return *this;
 	std::string _xerror = m._error;
 	std::vector<mathexpr*> _arguments = m.arguments;
+	std::vector<std::function<value()>> _promises = m.promises;
+	std::vector<void*> _operand_values = m.operand_values;
+	std::string _fixed_key = m.fixed_key;
 	if(m._value) {
 		if(!_value)
 			_value = m.type.copy_allocate(m._value);
@@ -123,11 +161,21 @@ mathexpr& mathexpr::operator=(const mathexpr& m)
 	owns_operator = m.owns_operator;
 	m.owns_operator = false;
 	std::swap(arguments, _arguments);
+	std::swap(promises, _promises);
+	std::swap(operand_values, _operand_values);
+	program.clear();
+	compiled = false;
+	std::swap(fixed_key, _fixed_key);
 	std::swap(_error, _xerror);
 	return *this;
 }
 
 value mathexpr::evaluate()
+{
+	return evaluate_node(false);
+}
+
+value mathexpr::evaluate_node(bool operands_ready)
 {
 	value ret;
 	ret.type = &type;
@@ -142,15 +190,20 @@ value mathexpr::evaluate()
 				}
 			}
 			state = EVALUATING;
-			std::vector<std::function<value()>> promises;
-			for(auto i : arguments) {
-				mathexpr* m = i;
-				promises.push_back([m]() { return m->evaluate(); });
-			}
 			value tmp;
 			tmp.type = &type;
 			tmp._value = _value;
-			fn->evaluate(tmp, promises);
+			if(fn->is_strict()) {
+				if(!operands_ready) {
+					if(!compiled)
+						compile();
+					run_program();
+				}
+				for(size_t i = 0; i < arguments.size(); i++)
+					operand_values[i] = arguments[i]->_value;
+				fn->evaluate_strict(tmp, operand_values.data(), operand_values.size());
+			} else
+				fn->evaluate(tmp, promises);
 			state = EVALUATED;
 		} catch(error& e) {
 			state = FAILED;
@@ -198,6 +251,186 @@ value mathexpr::evaluate()
 	throw error(error::INTERNAL, "Internal error (shouldn't be here)");
 }
 
+void mathexpr::make_promises()
+{
+	promises.clear();
+	for(auto i : arguments) {
+		mathexpr* m = i;
+		promises.push_back([m]() { return m->evaluate(); });
+	}
+	operand_values.resize(arguments.size());
+	program.clear();
+	compiled = false;
+}
+
+bool mathexpr::is_strict_operation()
+{
+	if(state != TO_BE_EVALUATED && state != EVALUATING && state != EVALUATED && state != FAILED)
+		return false;
+	if(!fn->is_strict())
+		return false;
+	//Mismatching types are reported when evaluating.
+	for(auto i : arguments)
+		if(&i->type != &type)
+			return false;
+	return true;
+}
+
+void mathexpr::compile()
+{
+	//Strict operations below this are evaluated from a flat list, operands first. The rest (values, variables
+	//and other operations) are leaves of the list, those evaluate themselves.
+	std::vector<mathexpr*> parents;
+	std::map<mathexpr*, size_t> index;
+	program.clear();
+	for(auto i : arguments)
+		i->flatten(this, program, parents, index);
+	for(size_t i = 0; i < program.size(); i++)
+		program[i].parent = index.count(parents[i]) ? index[parents[i]] : program.size();
+	compiled = true;
+}
+
+void mathexpr::flatten(mathexpr* _parent, std::vector<step>& out, std::vector<mathexpr*>& parents,
+	std::map<mathexpr*, size_t>& index)
+{
+	//Shared subexpressions only need to be evaluated once.
+	if(index.count(this))
+		return;
+	step s;
+	s.node = this;
+	s.parent = 0;
+	s.leaf = !is_strict_operation();
+	if(!s.leaf)
+		for(auto i : arguments)
+			i->flatten(this, out, parents, index);
+	index[this] = out.size();
+	out.push_back(s);
+	parents.push_back(_parent);
+}
+
+void mathexpr::run_program()
+{
+	for(size_t i = 0; i < program.size(); i++) {
+		mathexpr* n = program[i].node;
+		try {
+			if(!program[i].leaf && n->state == TO_BE_EVALUATED)
+				n->evaluate_node(true);
+			else
+				n->evaluate();
+		} catch(error& e) {
+			fail_ancestors(i, e.get_code(), e.what());
+			throw;
+		} catch(std::exception& e) {
+			fail_ancestors(i, error::UNKNOWN, e.what());
+			throw;
+		} catch(...) {
+			fail_ancestors(i, error::UNKNOWN, "Unknown error");
+			throw;
+		}
+	}
+}
+
+void mathexpr::fail_ancestors(size_t i, error::errorcode _errcode, const std::string& _xerror)
+{
+	//Like when evaluating recursively, the operations the error passes through fail too. This also lets resets
+	//reach the failed operation.
+	for(size_t j = program[i].parent; j < program.size(); j = program[j].parent) {
+		mathexpr* n = program[j].node;
+		if(n->state != TO_BE_EVALUATED)
+			continue;
+		n->state = FAILED;
+		n->errcode = _errcode;
+		n->_error = _xerror;
+	}
+}
+
+bool mathexpr::fold()
+{
+	if(state != TO_BE_EVALUATED || !fn->is_pure())
+		return false;
+	for(auto i : arguments)
+		if(i->state != FIXED)
+			return false;
+	try {
+		evaluate();
+	} catch(std::bad_alloc& e) {
+		throw;
+	} catch(...) {
+		//Leave the error to be reported when evaluating.
+		reset();
+		return false;
+	}
+	state = FIXED;
+	arguments.clear();
+	promises.clear();
+	operand_values.clear();
+	program.clear();
+	compiled = false;
+	return true;
+}
+
+GC::pointer<mathexpr> expr_pool::intern(GC::pointer<mathexpr> expr)
+{
+	mathexpr* e = intern(expr.as_pointer());
+	if(e == expr.as_pointer())
+		return expr;
+	//Raw pointer constructor does not add a root reference, but the destructor drops one.
+	e->mark_root();
+	return GC::pointer<mathexpr>(e);
+}
+
+mathexpr* expr_pool::intern(mathexpr* expr)
+{
+	if(keys.count(expr)) {
+		auto& k = keys[expr];
+		return (k != "" && nodes.count(k)) ? nodes[k] : expr;
+	}
+	keys[expr] = "";
+	//Forwards are not followed: the target is root of its own and must stay that way to get reset.
+	if(expr->state == mathexpr::TO_BE_EVALUATED) {
+		for(auto& i : expr->arguments)
+			i = intern(i);
+		expr->make_promises();
+	}
+	std::string key = key_of(expr);
+	if(expr->fold())
+		expr->fixed_key = key;
+	keys[expr] = key;
+	if(key == "")
+		return expr;
+	if(nodes.count(key))
+		return nodes[key];
+	nodes[key] = expr;
+	return expr;
+}
+
+std::string expr_pool::key_of(mathexpr* expr)
+{
+	std::ostringstream k;
+	k << "T" << &expr->type;
+	switch(expr->state) {
+	case mathexpr::FIXED:
+		if(expr->fixed_key == "")
+			return "";
+		k << expr->fixed_key;
+		return k.str();
+	case mathexpr::FORWARD:
+		k << "F" << expr->arguments[0];
+		return k.str();
+	case mathexpr::TO_BE_EVALUATED: {
+		std::string op = expr->fn->share_key();
+		if(op == "")
+			return "";
+		k << "O" << op.length() << ":" << op;
+		for(auto i : expr->arguments)
+			k << "," << i;
+		return k.str();
+	}
+	default:
+		return "";
+	}
+}
+
 void mathexpr::trace()
 {
 	for(auto i : arguments)
@@ -616,13 +849,15 @@ namespace
 }
 
 GC::pointer<mathexpr> mathexpr::parse(typeinfo& _type, const std::string& expr,
-	std::function<GC::pointer<mathexpr>(const std::string&)> vars)
+	std::function<GC::pointer<mathexpr>(const std::string&)> vars, expr_pool* pool)
 {
 	if(expr == "")
 		throw std::runtime_error("Empty expression");
 	auto operations = _type.operations();
 	std::vector<subexpression> tokenization;
 	tokenize(expr, operations, tokenization);
-	return parse_rec(_type, tokenization, operations, vars, 0, tokenization.size());
+	auto ret = parse_rec(_type, tokenization, operations, vars, 0, tokenization.size());
+	expr_pool tmp;
+	return (pool ? *pool : tmp).intern(ret);
 }
 }
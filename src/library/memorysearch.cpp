@@ -1,10 +1,13 @@
 #include "memoryspace.hpp"
 #include "memorysearch.hpp"
+#include "arch-detect.hpp"
+#include "cpu-features.hpp"
 #include "eatarg.hpp"
 #include "minmax.hpp"
 #include "serialization.hpp"
 #include "int24.hpp"
 #include <iostream>
+#include <type_traits>
 
 memory_search::memory_search(memory_space& space)
 	: mspace(space)
@@ -13,9 +16,31 @@ memory_search::memory_search(memory_space& space)
 }
 
 
+namespace
+{
+	//Comparison kinds the vectorized kernels know about.
+	enum search_kind
+	{
+		MS_ALL,
+		MS_VALUE,
+		MS_DIFFERENCE,
+		MS_LT,
+		MS_LE,
+		MS_EQ,
+		MS_NE,
+		MS_GE,
+		MS_GT,
+		MS_SEQLT,
+		MS_SEQLE,
+		MS_SEQGE,
+		MS_SEQGT,
+	};
+}
+
 struct search_update
 {
 	typedef uint8_t value_type;
+	static const int simd_op = MS_ALL;
 	bool operator()(uint8_t oldv, uint8_t newv) const throw() { return true; }
 };
 
@@ -23,6 +48,7 @@ template<typename T>
 struct search_value
 {
 	typedef T value_type;
+	static const int simd_op = MS_VALUE;
 	search_value(T v) throw() { val = v; }
 	bool operator()(T oldv, T newv) const throw() { return (newv == val); }
 	T val;
@@ -32,6 +58,7 @@ template<typename T>
 struct search_difference
 {
 	typedef T value_type;
+	static const int simd_op = MS_DIFFERENCE;
 	search_difference(T v) throw() { val = v; }
 	bool operator()(T oldv, T newv) const throw() { return ((newv - oldv) == val); }
 	T val;
@@ -41,6 +68,7 @@ template<typename T>
 struct search_lt
 {
 	typedef T value_type;
+	static const int simd_op = MS_LT;
 	bool operator()(T oldv, T newv) const throw() { return (newv < oldv); }
 };
 
@@ -48,6 +76,7 @@ template<typename T>
 struct search_le
 {
 	typedef T value_type;
+	static const int simd_op = MS_LE;
 	bool operator()(T oldv, T newv) const throw() { return (newv <= oldv); }
 };
 
@@ -55,6 +84,7 @@ template<typename T>
 struct search_eq
 {
 	typedef T value_type;
+	static const int simd_op = MS_EQ;
 	bool operator()(T oldv, T newv) const throw() { return (newv == oldv); }
 };
 
@@ -62,6 +92,7 @@ template<typename T>
 struct search_ne
 {
 	typedef T value_type;
+	static const int simd_op = MS_NE;
 	bool operator()(T oldv, T newv) const throw() { return (newv != oldv); }
 };
 
@@ -69,6 +100,7 @@ template<typename T>
 struct search_ge
 {
 	typedef T value_type;
+	static const int simd_op = MS_GE;
 	bool operator()(T oldv, T newv) const throw() { return (newv >= oldv); }
 };
 
@@ -76,6 +108,7 @@ template<typename T>
 struct search_gt
 {
 	typedef T value_type;
+	static const int simd_op = MS_GT;
 	bool operator()(T oldv, T newv) const throw() { return (newv > oldv); }
 };
 
@@ -83,6 +116,7 @@ template<typename T>
 struct search_seqlt
 {
 	typedef T value_type;
+	static const int simd_op = MS_SEQLT;
 	bool operator()(T oldv, T newv) const throw()
 	{
 		T mask = (T)1 << (sizeof(T) * 8 - 1);
@@ -95,6 +129,7 @@ template<typename T>
 struct search_seqle
 {
 	typedef T value_type;
+	static const int simd_op = MS_SEQLE;
 	bool operator()(T oldv, T newv) const throw()
 	{
 		T mask = (T)1 << (sizeof(T) * 8 - 1);
@@ -107,6 +142,7 @@ template<typename T>
 struct search_seqge
 {
 	typedef T value_type;
+	static const int simd_op = MS_SEQGE;
 	bool operator()(T oldv, T newv) const throw()
 	{
 		T mask = (T)1 << (sizeof(T) * 8 - 1);
@@ -119,6 +155,7 @@ template<typename T>
 struct search_seqgt
 {
 	typedef T value_type;
+	static const int simd_op = MS_SEQGT;
 	bool operator()(T oldv, T newv) const throw()
 	{
 		T mask = (T)1 << (sizeof(T) * 8 - 1);
@@ -128,6 +165,170 @@ struct search_seqgt
 };
 
 
+namespace
+{
+	template<unsigned W> struct width {};
+
+	//Spread bits so that bit k moves to bit W*k.
+	inline uint64_t spread_bits(uint64_t x, width<1> w) { return x; }
+	inline uint64_t spread_bits(uint64_t x, width<2> w)
+	{
+		x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+		x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+		x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		x = (x | (x << 2)) & 0x3333333333333333ULL;
+		return (x | (x << 1)) & 0x5555555555555555ULL;
+	}
+	inline uint64_t spread_bits(uint64_t x, width<4> w)
+	{
+		x = (x | (x << 24)) & 0x000000FF000000FFULL;
+		x = (x | (x << 12)) & 0x000F000F000F000FULL;
+		x = (x | (x << 6)) & 0x0303030303030303ULL;
+		return (x | (x << 3)) & 0x1111111111111111ULL;
+	}
+
+	//Types the vectorized kernels handle.
+	template<typename T> struct simd_searchable { static const bool value = false; };
+	template<> struct simd_searchable<int8_t> { static const bool value = true; };
+	template<> struct simd_searchable<uint8_t> { static const bool value = true; };
+	template<> struct simd_searchable<int16_t> { static const bool value = true; };
+	template<> struct simd_searchable<uint16_t> { static const bool value = true; };
+	template<> struct simd_searchable<int32_t> { static const bool value = true; };
+	template<> struct simd_searchable<uint32_t> { static const bool value = true; };
+
+	//Searches the vectorized kernels handle. Differences of types narrower than int are computed after
+	//promotion, so they don't wrap like vector lanes do.
+	template<typename F> struct simd_usable
+	{
+		typedef typename F::value_type T;
+		static const bool value = simd_searchable<T>::value &&
+			!(F::simd_op == MS_DIFFERENCE && sizeof(T) < sizeof(int));
+	};
+
+	template<typename F> typename F::value_type simd_value(const F& f) { return 0; }
+	template<typename T> T simd_value(const search_value<T>& f) { return f.val; }
+	template<typename T> T simd_value(const search_difference<T>& f) { return f.val; }
+}
+
+#ifdef ARCH_HAS_I386_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+namespace memorysearch_sse2
+{
+	typedef __m128i vtype;
+	const unsigned vbytes = 16;
+	inline vtype vload(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const vtype*>(p)); }
+	inline vtype vzero() { return _mm_setzero_si128(); }
+	inline vtype vones() { return _mm_set1_epi32(-1); }
+	inline vtype vor(vtype a, vtype b) { return _mm_or_si128(a, b); }
+	inline vtype vxor(vtype a, vtype b) { return _mm_xor_si128(a, b); }
+	inline vtype vandnot(vtype a, vtype b) { return _mm_andnot_si128(a, b); }
+	inline vtype vset1(uint32_t v, width<1> w) { return _mm_set1_epi8((char)v); }
+	inline vtype vset1(uint32_t v, width<2> w) { return _mm_set1_epi16((short)v); }
+	inline vtype vset1(uint32_t v, width<4> w) { return _mm_set1_epi32((int)v); }
+	inline vtype vcmpeq(vtype a, vtype b, width<1> w) { return _mm_cmpeq_epi8(a, b); }
+	inline vtype vcmpeq(vtype a, vtype b, width<2> w) { return _mm_cmpeq_epi16(a, b); }
+	inline vtype vcmpeq(vtype a, vtype b, width<4> w) { return _mm_cmpeq_epi32(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<1> w) { return _mm_cmpgt_epi8(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<2> w) { return _mm_cmpgt_epi16(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<4> w) { return _mm_cmpgt_epi32(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<1> w) { return _mm_sub_epi8(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<2> w) { return _mm_sub_epi16(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<4> w) { return _mm_sub_epi32(a, b); }
+	inline vtype vbswap(vtype a, width<1> w) { return a; }
+	inline vtype vbswap(vtype a, width<2> w) { return _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8)); }
+	inline vtype vbswap(vtype a, width<4> w)
+	{
+		a = vbswap(a, width<2>());
+		a = _mm_shufflelo_epi16(a, 0xB1);
+		return _mm_shufflehi_epi16(a, 0xB1);
+	}
+	inline uint32_t vmask(vtype a, width<1> w) { return _mm_movemask_epi8(a); }
+	inline uint32_t vmask(vtype a, width<2> w) { return _mm_movemask_epi8(_mm_packs_epi16(a, vzero())); }
+	inline uint32_t vmask(vtype a, width<4> w) { return _mm_movemask_ps(_mm_castsi128_ps(a)); }
+#include "memorysearch-simd.inc"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+namespace memorysearch_avx2
+{
+	typedef __m256i vtype;
+	const unsigned vbytes = 32;
+	inline vtype vload(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const vtype*>(p)); }
+	inline vtype vzero() { return _mm256_setzero_si256(); }
+	inline vtype vones() { return _mm256_set1_epi32(-1); }
+	inline vtype vor(vtype a, vtype b) { return _mm256_or_si256(a, b); }
+	inline vtype vxor(vtype a, vtype b) { return _mm256_xor_si256(a, b); }
+	inline vtype vandnot(vtype a, vtype b) { return _mm256_andnot_si256(a, b); }
+	inline vtype vset1(uint32_t v, width<1> w) { return _mm256_set1_epi8((char)v); }
+	inline vtype vset1(uint32_t v, width<2> w) { return _mm256_set1_epi16((short)v); }
+	inline vtype vset1(uint32_t v, width<4> w) { return _mm256_set1_epi32((int)v); }
+	inline vtype vcmpeq(vtype a, vtype b, width<1> w) { return _mm256_cmpeq_epi8(a, b); }
+	inline vtype vcmpeq(vtype a, vtype b, width<2> w) { return _mm256_cmpeq_epi16(a, b); }
+	inline vtype vcmpeq(vtype a, vtype b, width<4> w) { return _mm256_cmpeq_epi32(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<1> w) { return _mm256_cmpgt_epi8(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<2> w) { return _mm256_cmpgt_epi16(a, b); }
+	inline vtype vcmpgt(vtype a, vtype b, width<4> w) { return _mm256_cmpgt_epi32(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<1> w) { return _mm256_sub_epi8(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<2> w) { return _mm256_sub_epi16(a, b); }
+	inline vtype vsub(vtype a, vtype b, width<4> w) { return _mm256_sub_epi32(a, b); }
+	inline vtype vbswap(vtype a, width<1> w) { return a; }
+	inline vtype vbswap(vtype a, width<2> w)
+	{
+		return _mm256_shuffle_epi8(a, _mm256_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+			14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1));
+	}
+	inline vtype vbswap(vtype a, width<4> w)
+	{
+		return _mm256_shuffle_epi8(a, _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+			12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+	}
+	inline uint32_t vmask(vtype a, width<1> w) { return _mm256_movemask_epi8(a); }
+	inline uint32_t vmask(vtype a, width<2> w)
+	{
+		//Packing works within 128-bit halves.
+		uint32_t m = _mm256_movemask_epi8(_mm256_packs_epi16(a, vzero()));
+		return (m & 0xFF) | ((m >> 8) & 0xFF00);
+	}
+	inline uint32_t vmask(vtype a, width<4> w) { return _mm256_movemask_ps(_mm256_castsi256_ps(a)); }
+#include "memorysearch-simd.inc"
+}
+#pragma GCC pop_options
+#endif
+
+namespace
+{
+	template<typename T, int op>
+	bool simd_word(uint64_t& match, const uint8_t* newv, const uint8_t* oldv, T value, int endian,
+		std::false_type searchable)
+	{
+		return false;
+	}
+
+	template<typename T, int op>
+	bool simd_word(uint64_t& match, const uint8_t* newv, const uint8_t* oldv, T value, int endian,
+		std::true_type searchable)
+	{
+#ifdef ARCH_HAS_I386_INTRINSICS
+		//x86 is little-endian.
+		bool swap = (endian == 1);
+		if(cpu_features::avx2()) {
+			match = memorysearch_avx2::match_word<T, op>(newv, oldv, value, swap);
+			return true;
+		}
+		if(cpu_features::sse2()) {
+			match = memorysearch_sse2::match_word<T, op>(newv, oldv, value, swap);
+			return true;
+		}
+#endif
+		return false;
+	}
+}
+
 template<typename T>
 struct search_value_helper
 {
@@ -144,6 +345,19 @@ struct search_value_helper
 		value_type v2 = serialization::read_endian<value_type>(newv, endian);
 		return val(v1, v2);
 	}
+/**
+ * Compute match mask for 64 consecutive candidates at once, if possible.
+ *
+ * Parameter match: Bit k is set if candidate at offset k matches.
+ * Returns: True if computed, false if the generic per-address path has to be used.
+ */
+	bool word(uint64_t& match, const uint8_t* newv, const uint8_t* oldv, uint64_t left, int endian) const throw()
+	{
+		if(left < 64 + sizeof(value_type) - 1)
+			return false;
+		return simd_word<value_type, T::simd_op>(match, newv, oldv, simd_value(val), endian,
+			std::integral_constant<bool, simd_usable<T>::value>());
+	}
 	const T& val;
 };
 
@@ -196,6 +410,18 @@ namespace
 				i = next_multiple_of_64(i);
 				j += i - old_i;
 			}
+			if(j >= rsize)
+				break;
+			//Whole word at once if possible.
+			uint64_t match;
+			if(i % 64 == 0 && helper.word(match, mem + j, &previous_content[i], rsize - j, endian)) {
+				uint64_t& w = still_in[i / 64];
+				candidates -= __builtin_popcountll(w & ~match);
+				w &= match;
+				i += 63;
+				j += 63;
+				continue;
+			}
 			//This might match. Check it.
 			if(!helper(mem + j, &previous_content[i], rsize - j, endian))
 				dq_entry(still_in, candidates, i);
@@ -72,6 +72,27 @@ namespace
 		} else
 			return r.write(offset, buffer, bsize);
 	}
+
+	//Global so that cache entry can't be mistaken as belonging to another memory space. 0 is never valid.
+	std::atomic<uint64_t> next_generation(1);
+
+	//Per-thread cache of last region looked up.
+	struct tlb_entry
+	{
+		uint64_t generation;
+		memory_space::region* r;
+		uint64_t base;
+		uint64_t last;
+		void fill(uint64_t gen, memory_space::region* _r, uint64_t _base, uint64_t _last)
+		{
+			generation = gen;
+			r = _r;
+			base = _base;
+			last = _last;
+		}
+	};
+	thread_local tlb_entry phys_tlb;
+	thread_local tlb_entry linear_tlb;
 }
 
 memory_space::region::~region() throw()
@@ -99,9 +120,28 @@ bool memory_space::region::write(uint64_t offset, const void* buffer, size_t tsi
 	return true;
 }
 
+memory_space::memory_space()
+{
+	table = new region_table;
+	table.load()->linear_bases.push_back(0);
+	table.load()->linear_size = 0;
+	readers = 0;
+	generation = next_generation++;
+}
+
+memory_space::~memory_space()
+{
+	delete table.load();
+}
+
 std::pair<memory_space::region*, uint64_t> memory_space::lookup(uint64_t address)
 {
-	threads::alock m(mlock);
+	tlb_entry& c = phys_tlb;
+	if(c.generation == generation.load(std::memory_order_acquire) && address >= c.base && address <= c.last)
+		return std::make_pair(c.r, address - c.base);
+	uint64_t gen = generation.load(std::memory_order_acquire);
+	table_ref t(*this);
+	auto& u_regions = t->regions;
 	size_t lb = 0;
 	size_t ub = u_regions.size();
 	while(lb < ub) {
@@ -114,6 +154,7 @@ std::pair<memory_space::region*, uint64_t> memory_space::lookup(uint64_t address
 			lb = mb + 1;
 			continue;
 		}
+		c.fill(gen, u_regions[mb], u_regions[mb]->base, u_regions[mb]->last_address());
 		return std::make_pair(u_regions[mb], address - u_regions[mb]->base);
 	}
 	return std::make_pair(reinterpret_cast<region*>(NULL), 0);
@@ -121,8 +162,13 @@ std::pair<memory_space::region*, uint64_t> memory_space::lookup(uint64_t address
 
 std::pair<memory_space::region*, uint64_t> memory_space::lookup_linear(uint64_t linear)
 {
-	threads::alock m(mlock);
-	if(linear >= linear_size)
+	tlb_entry& c = linear_tlb;
+	if(c.generation == generation.load(std::memory_order_acquire) && linear >= c.base && linear <= c.last)
+		return std::make_pair(c.r, linear - c.base);
+	uint64_t gen = generation.load(std::memory_order_acquire);
+	table_ref t(*this);
+	auto& linear_bases = t->linear_bases;
+	if(linear >= t->linear_size)
 		return std::make_pair(reinterpret_cast<region*>(NULL), 0);
 	size_t lb = 0;
 	size_t ub = linear_bases.size() - 1;
@@ -136,11 +182,24 @@ std::pair<memory_space::region*, uint64_t> memory_space::lookup_linear(uint64_t
 			lb = mb + 1;
 			continue;
 		}
-		return std::make_pair(u_lregions[mb], linear - linear_bases[mb]);
+		c.fill(gen, t->lregions[mb], linear_bases[mb], linear_bases[mb + 1] - 1);
+		return std::make_pair(t->lregions[mb], linear - linear_bases[mb]);
 	}
 	return std::make_pair(reinterpret_cast<region*>(NULL), 0);
 }
 
+size_t memory_space::get_region_count()
+{
+	table_ref t(*this);
+	return t->regions.size();
+}
+
+uint64_t memory_space::get_linear_size()
+{
+	table_ref t(*this);
+	return t->linear_size;
+}
+
 void memory_space::read_all_linear_memory(uint8_t* buffer)
 {
 	auto g = lookup_linear(0);
@@ -244,18 +303,18 @@ bool memory_space::write_range_linear(uint64_t address, const void* buffer, size
 
 memory_space::region* memory_space::lookup_n(size_t n)
 {
-	threads::alock m(mlock);
-	if(n >= u_regions.size())
+	table_ref t(*this);
+	if(n >= t->regions.size())
 		return NULL;
-	return u_regions[n];
+	return t->regions[n];
 }
 
 
 std::list<memory_space::region*> memory_space::get_regions()
 {
-	threads::alock m(mlock);
+	table_ref t(*this);
 	std::list<region*> r;
-	for(auto i : u_regions)
+	for(auto i : t->regions)
 		r.push_back(i);
 	return r;
 }
@@ -278,42 +337,49 @@ char* memory_space::get_physical_mapping(uint64_t base, uint64_t size)
 void memory_space::set_regions(const std::list<memory_space::region*>& regions)
 {
 	threads::alock m(mlock);
-	std::vector<region*> n_regions;
-	std::vector<region*> n_lregions;
-	std::vector<uint64_t> n_linear_bases;
-	//Calculate array sizes.
-	n_regions.resize(regions.size());
-	size_t linear_c = 0;
-	for(auto i : regions)
-		if(!i->readonly && !i->special)
-			linear_c++;
-	n_lregions.resize(linear_c);
-	n_linear_bases.resize(linear_c + 1);
-
-	//Fill the main array (it must be sorted!).
-	size_t i = 0;
-	for(auto j : regions)
-		n_regions[i++] = j;
-	std::sort(n_regions.begin(), n_regions.end(),
-		[](region* a, region* b) -> bool { return a->base < b->base; });
-
-	//Fill linear address arrays from the main array.
-	i = 0;
-	uint64_t base = 0;
-	for(auto j : n_regions) {
-		if(j->readonly || j->special)
-			continue;
-		n_lregions[i] = j;
-		n_linear_bases[i] = base;
-		base = base + j->size;
-		i++;
+	region_table* n = new region_table;
+	try {
+		//Calculate array sizes.
+		n->regions.resize(regions.size());
+		size_t linear_c = 0;
+		for(auto i : regions)
+			if(!i->readonly && !i->special)
+				linear_c++;
+		n->lregions.resize(linear_c);
+		n->linear_bases.resize(linear_c + 1);
+
+		//Fill the main array (it must be sorted!).
+		size_t i = 0;
+		for(auto j : regions)
+			n->regions[i++] = j;
+		std::sort(n->regions.begin(), n->regions.end(),
+			[](region* a, region* b) -> bool { return a->base < b->base; });
+
+		//Fill linear address arrays from the main array.
+		i = 0;
+		uint64_t base = 0;
+		for(auto j : n->regions) {
+			if(j->readonly || j->special)
+				continue;
+			n->lregions[i] = j;
+			n->linear_bases[i] = base;
+			base = base + j->size;
+			i++;
+		}
+		n->linear_bases[i] = base;
+		n->linear_size = base;
+	} catch(...) {
+		delete n;
+		throw;
 	}
-	n_linear_bases[i] = base;
 
-	std::swap(u_regions, n_regions);
-	std::swap(u_lregions, n_lregions);
-	std::swap(linear_bases, n_linear_bases);
-	linear_size = base;
+	//Publish the new table and invalidate cached lookups. The old table can be freed once no reader can still
+	//be using it.
+	region_table* old = table.exchange(n);
+	generation = next_generation++;
+	while(readers.load())
+		threads::yield();
+	delete old;
 }
 
 int memory_space::_get_system_endian()
@@ -328,8 +394,8 @@ int memory_space::sysendian = 0;
 
 std::string memory_space::address_to_textual(uint64_t addr)
 {
-	threads::alock m(mlock);
-	for(auto i : u_regions) {
+	table_ref t(*this);
+	for(auto i : t->regions) {
 		if(addr >= i->base && addr <= i->last_address()) {
 			return (stringfmt() << i->name << "+" << std::hex << (addr - i->base)).str();
 		}
@@ -25,7 +25,16 @@ memread_oper::memread_oper()
 
 memread_oper::~memread_oper() {}
 
-void memread_oper::evaluate(mathexpr::value target, std::vector<std::function<mathexpr::value()>> promises)
+std::string memread_oper::share_key()
+{
+	std::ostringstream x;
+	x << "M" << bytes << "," << signed_flag << "," << float_flag << "," << endianess << "," << scale_div << ","
+		<< addr_base << "," << addr_size << "," << mspace;
+	return x.str();
+}
+
+void memread_oper::evaluate(mathexpr::value target,
+	const std::vector<std::function<mathexpr::value()>>& promises)
 {
 	if(promises.size() != 1)
 		throw mathexpr::error(mathexpr::error::ARGCOUNT, "Memory read operator takes 1 argument");
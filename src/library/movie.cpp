@@ -12,6 +12,8 @@
 namespace
 {
 	const char* movie_id = "Movies";
+	//Seeks forward by at most this many frames walk the movie instead of looking up the sync index.
+	const uint64_t seek_walk_limit = 64;
 	bool movies_compatible(portctrl::frame_vector& old_movie, portctrl::frame_vector& new_movie,
 		uint64_t frame, const uint32_t* polls, const std::string& old_projectid,
 		const std::string& new_projectid)
@@ -69,6 +71,30 @@ uint32_t movie::count_changes(uint64_t first_subframe) throw()
 	return movie_data->subframe_count(first_subframe);
 }
 
+uint64_t movie::first_subframe(uint64_t frame)
+{
+	//The first frame starts at first subframe even without sync flag, the rest start at sync subframes.
+	if(frame <= 1)
+		return 0;
+	uint64_t initial_sync = (movie_data->find_frame(1) == 0) ? 1 : 0;
+	int64_t p = movie_data->find_frame(frame - 1 + initial_sync);
+	return (p < 0) ? movie_data->size() : p;
+}
+
+uint64_t movie::seek_frame(uint64_t frame)
+{
+	if(frame < cached_frame || frame - cached_frame > seek_walk_limit) {
+		cached_subframe = first_subframe(frame);
+	} else {
+		uint64_t p = cached_subframe;
+		for(uint64_t i = cached_frame; i < frame; i++)
+			p = p + count_changes(p);
+		cached_subframe = p;
+	}
+	cached_frame = frame;
+	return cached_subframe;
+}
+
 portctrl::frame movie::get_controls() throw()
 {
 	if(!readonly)
@@ -84,7 +110,7 @@ portctrl::frame movie::get_controls() throw()
 	for(size_t i = 0; i < movie_data->get_types().indices(); i++) {
 		uint32_t polls = pollcounters.get_polls(i);
 		uint32_t index = (changes > polls) ? polls : changes - 1;
-		c.axis2(i, (*movie_data)[current_frame_first_subframe + index].axis2(i));
+		c.axis2(i, movie_data->read_frame(current_frame_first_subframe + index).axis2(i));
 	}
 	return c;
 }
@@ -156,7 +182,8 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 		uint32_t changes = count_changes(current_frame_first_subframe);
 		uint32_t polls = pollcounters.get_polls(port, controller, ctrl);
 		uint32_t index = (changes > polls) ? polls : changes - 1;
-		int16_t data = (*movie_data)[current_frame_first_subframe + index].axis3(port, controller, ctrl);
+		int16_t data = movie_data->read_frame(current_frame_first_subframe + index).axis3(port, controller,
+			ctrl);
 		pollcounters.increment_polls(port, controller, ctrl);
 		return data;
 	} else {
@@ -170,7 +197,7 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 			movie_data->append(current_controls.copy(true));
 			//current_frame_first_subframe should be movie_data->size(), so it is right.
 			pollcounters.increment_polls(port, controller, ctrl);
-			return (*movie_data)[current_frame_first_subframe].axis3(port, controller, ctrl);
+			return movie_data->read_frame(current_frame_first_subframe).axis3(port, controller, ctrl);
 		}
 		short new_value = current_controls.axis3(port, controller, ctrl);
 		//Fortunately, we know this frame is the last one in movie_data.
@@ -180,11 +207,11 @@ short movie::next_input(unsigned port, unsigned controller, unsigned ctrl)
 			//subframes.
 			for(uint64_t i = current_frame_first_subframe + pollcounter; i < movie_data->size(); i++)
 				(*movie_data)[i].axis3(port, controller, ctrl, new_value);
-		} else if(new_value != (*movie_data)[movie_data->size() - 1].axis3(port, controller, ctrl)) {
+		} else if(new_value != movie_data->read_frame(movie_data->size() - 1).axis3(port, controller, ctrl)) {
 			//The index is not within existing size and value does not match. We need to create a new
 			//subframes(s), copying the last subframe.
 			while(current_frame_first_subframe + pollcounter >= movie_data->size())
-				movie_data->append((*movie_data)[movie_data->size() - 1].copy(false));
+				movie_data->append(movie_data->read_frame(movie_data->size() - 1).copy(false));
 			(*movie_data)[current_frame_first_subframe + pollcounter].axis3(port, controller, ctrl,
 				new_value);
 		}
@@ -265,9 +292,11 @@ void movie::readonly_mode(bool enable)
 		for(size_t i = 1; i < movie_data->get_types().indices(); i++) {
 			uint32_t polls = pollcounters.get_polls(i);
 			polls = polls ? polls : 1;
+			if(current_frame_first_subframe + polls >= next_frame_first_subframe)
+				continue;
+			short v = movie_data->read_frame(current_frame_first_subframe + polls - 1).axis2(i);
 			for(uint64_t j = current_frame_first_subframe + polls; j < next_frame_first_subframe; j++)
-				(*movie_data)[j].axis2(i, (*movie_data)[current_frame_first_subframe + polls - 1].
-					axis2(i));
+				(*movie_data)[j].axis2(i, v);
 		}
 	}
 }
@@ -290,9 +319,7 @@ size_t movie::restore_state(uint64_t curframe, uint64_t lagframe, const std::vec
 	if(old_movie && !movies_compatible(*old_movie, *movie_data, curframe, &pcounters[0], old_projectid,
 		_project_id))
 		throw std::runtime_error("Save is not from this movie");
-	uint64_t tmp_firstsubframe = 0;
-	for(uint64_t i = 1; i < curframe; i++)
-		tmp_firstsubframe = tmp_firstsubframe + count_changes(tmp_firstsubframe);
+	uint64_t tmp_firstsubframe = first_subframe(curframe);
 	//Checks have passed, copy the data.
 	readonly = true;
 	current_frame = curframe;
@@ -303,18 +330,11 @@ size_t movie::restore_state(uint64_t curframe, uint64_t lagframe, const std::vec
 	return 0;
 }
 
-uint64_t movie::frame_subframes(uint64_t frame) throw()
+uint64_t movie::frame_subframes(uint64_t frame)
 {
 	if(!frame) return 0;
 	if(frame > movie_data->size()) return 0;
-	if(frame < cached_frame)
-		clear_caches();
-	uint64_t p = cached_subframe;
-	for(uint64_t i = cached_frame; i < frame; i++)
-		p = p + count_changes(p);
-	cached_frame = frame;
-	cached_subframe = p;
-	return count_changes(p);
+	return count_changes(seek_frame(frame));
 }
 
 void movie::clear_caches() throw()
@@ -323,22 +343,16 @@ void movie::clear_caches() throw()
 	cached_subframe = 0;
 }
 
-portctrl::frame movie::read_subframe(uint64_t frame, uint64_t subframe) throw()
+portctrl::frame movie::read_subframe(uint64_t frame, uint64_t subframe)
 {
-	if(frame < cached_frame)
-		clear_caches();
-	uint64_t p = cached_subframe;
-	for(uint64_t i = cached_frame; i < frame; i++)
-		p = p + count_changes(p);
-	cached_frame = frame;
-	cached_subframe = p;
+	uint64_t p = seek_frame(frame);
 	uint64_t max = count_changes(p);
 	if(!max) {
 		return movie_data->blank_frame(true);
 	}
 	if(max <= subframe)
 		subframe = max - 1;
-	return (*movie_data)[p + subframe];
+	return movie_data->read_frame(p + subframe);
 }
 
 void movie::reset_state() throw()
@@ -359,14 +373,15 @@ void movie::fast_save(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::ve
 	_lagc = lag_frames;
 }
 
-void movie::fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& _counters)
+void movie::fast_load(uint64_t& _frame, uint64_t& _ptr, uint64_t& _lagc, std::vector<uint32_t>& _counters,
+	bool ro)
 {
 	readonly = true;
 	current_frame = _frame;
 	current_frame_first_subframe = (_ptr <= movie_data->size()) ? _ptr : movie_data->size();
 	lag_frames = _lagc;
 	pollcounters.load_state(_counters);
-	readonly_mode(false);
+	readonly_mode(ro);
 }
 
 void movie::set_pflag_handler(poll_flag* handler)
@@ -381,7 +396,7 @@ int16_t movie::read_subframe_at_index(uint32_t subframe, unsigned port, unsigned
 		return 0;
 	uint32_t changes = count_changes(current_frame_first_subframe);
 	uint32_t index = (changes > subframe) ? subframe : changes - 1;
-	return (*movie_data)[current_frame_first_subframe + index].axis3(port, controller, ctrl);
+	return movie_data->read_frame(current_frame_first_subframe + index).axis3(port, controller, ctrl);
 }
 
 void movie::write_subframe_at_index(uint32_t subframe, unsigned port, unsigned controller, unsigned ctrl,
@@ -12,12 +12,21 @@
 #include <list>
 #include <deque>
 #include <complex>
+#include <algorithm>
 
 namespace portctrl
 {
 const char* movie_page_id = "Input tracks";
 namespace
 {
+	uint32_t count_syncs(const unsigned char* content, size_t frames, size_t stride)
+	{
+		uint32_t ret = 0;
+		for(size_t i = 0; i < frames; i++)
+			ret += content[i * stride] & 1;
+		return ret;
+	}
+
 	controller simple_controller = {"(system)", "system", {}};
 	controller_set simple_port = {"system", "system", "system", {simple_controller},{0}};
 
@@ -470,7 +479,7 @@ frame& frame::operator=(const frame& obj)
 	types = obj.types;
 	short old = sync();
 	memcpy(backing, obj.backing, types->size());
-	if(host) host->notify_sync_change(sync() - old);
+	if(host) host->notify_sync_change(sync() - old, backing);
 	return *this;
 }
 
@@ -488,19 +497,15 @@ size_t frame_vector::walk_helper(size_t frame, bool sflag) throw()
 	size_t page = frame / frames_per_page;
 	size_t offset = frame_size * (frame % frames_per_page);
 	size_t index = frame % frames_per_page;
-	if(cache_page_num != page) {
-		cache_page = &pages[page];
-		cache_page_num = page;
-	}
+	const unsigned char* content = (frame < frames) ? read_page(page) : NULL;
 	while(frame < frames) {
 		if(index == frames_per_page) {
 			page++;
-			cache_page = &pages[page];
-			cache_page_num = page;
+			content = read_page(page);
 			index = 0;
 			offset = 0;
 		}
-		if(frame::sync(cache_page->content + offset))
+		if(frame::sync(content + offset))
 			break;
 		index++;
 		offset += frame_size;
@@ -513,29 +518,49 @@ size_t frame_vector::walk_helper(size_t frame, bool sflag) throw()
 size_t frame_vector::recount_frames() throw()
 {
 	uint64_t old_frame_count = real_frame_count;
-	size_t ret = 0;
-	if(!frames)
-		return 0;
-	cache_page_num = 0;
-	cache_page = &pages[0];
-	size_t offset = 0;
-	size_t index = 0;
-	for(size_t i = 0; i < frames; i++) {
-		if(index == frames_per_page) {
-			cache_page_num++;
-			cache_page = &pages[cache_page_num];
-			index = 0;
-			offset = 0;
+	size_t pagecount = (frames + frames_per_page - 1) / frames_per_page;
+	for(size_t i = 0; i < pagecount; i++)
+		pages.find(i)->second.read().syncs_valid = false;
+	sync_index_valid = 0;
+	update_sync_index();
+	real_frame_count = sync_index[pagecount];
+	call_framecount_notification(old_frame_count);
+	return real_frame_count;
+}
+
+void frame_vector::update_sync_index()
+{
+	size_t pagecount = (frames + frames_per_page - 1) / frames_per_page;
+	sync_index.resize(pagecount + 1);
+	sync_index[0] = 0;
+	for(size_t i = sync_index_valid; i < pagecount; i++) {
+		const page& pg = pages.find(i)->second.read();
+		if(!pg.syncs_valid) {
+			pg.syncs = count_syncs(pg.content, frames_per_page, frame_size);
+			pg.syncs_valid = true;
 		}
-		if(frame::sync(cache_page->content + offset))
-			ret++;
-		index++;
-		offset += frame_size;
+		sync_index[i + 1] = sync_index[i] + pg.syncs;
+	}
+	sync_index_valid = pagecount;
+}
 
+void frame_vector::notify_sync_change(short polarity, const unsigned char* frame)
+{
+	uint64_t old_frame_count = real_frame_count;
+	real_frame_count = real_frame_count + polarity;
+	if(polarity) {
+		//The frame is nearly always in the cached page, as frames are written right after operator[].
+		if(cache_page && frame >= cache_page->content && frame < cache_page->content +
+			CONTROLLER_PAGE_SIZE) {
+			cache_page->syncs += polarity;
+			invalidate_sync_index(cache_page_num);
+		} else {
+			for(auto& i : pages)
+				i.second.read().syncs_valid = false;
+			sync_index_valid = 0;
+		}
 	}
-	real_frame_count = ret;
-	call_framecount_notification(old_frame_count);
-	return ret;
+	if(!freeze_count) call_framecount_notification(old_frame_count);
 }
 
 void frame_vector::clear(const type_set& p)
@@ -547,6 +572,8 @@ void frame_vector::clear(const type_set& p)
 	types = &p;
 	clear_cache();
 	pages.clear();
+	sync_index.clear();
+	sync_index_valid = 0;
 	real_frame_count = 0;
 	call_framecount_notification(old_frame_count);
 }
@@ -587,10 +614,14 @@ void frame_vector::append(frame cframe)
 	size_t offset = frame_size * (frames % frames_per_page);
 	if(cache_page_num != page) {
 		cache_page_num = page;
-		cache_page = &pages[page];
+		cache_page = &pages[page].write();
 	}
 	frame(cache_page->content + offset, *types) = cframe;
-	if(cframe.sync()) real_frame_count++;
+	if(cframe.sync()) {
+		real_frame_count++;
+		cache_page->syncs++;
+		invalidate_sync_index(page);
+	}
 	frames++;
 }
 
@@ -608,22 +639,21 @@ frame_vector& frame_vector::operator=(const frame_vector& v)
 	if(this == &v)
 		return *this;
 	uint64_t old_frame_count = real_frame_count;
-	resize(v.frames);
+	//Share the pages. Neither vector may have cached page pointer after this, as cached pages are written
+	//without checking if those are shared.
+	std::map<size_t, page_ref> npages = v.pages;
 	clear_cache();
+	v.clear_cache();
 
-	//Copy the fields.
+	//This can't fail anymore. Copy the fields.
+	std::swap(pages, npages);
 	frame_size = v.frame_size;
 	frames_per_page = v.frames_per_page;
+	frames = v.frames;
 	types = v.types;
 	real_frame_count = v.real_frame_count;
-
-	//This can't fail anymore. Copy the raw page contents.
-	size_t pagecount = (frames + frames_per_page - 1) / frames_per_page;
-	for(size_t i = 0; i < pagecount; i++) {
-		page& pg = pages[i];
-		const page& pg2 = v.pages.find(i)->second;
-		pg = pg2;
-	}
+	sync_index = v.sync_index;
+	sync_index_valid = v.sync_index_valid;
 	call_framecount_notification(old_frame_count);
 	return *this;
 }
@@ -637,7 +667,7 @@ void frame_vector::resize(size_t newsize)
 		//Shrink movie.
 		uint64_t old_frame_count = real_frame_count;
 		for(size_t i = newsize; i < frames; i++)
-			if((*this)[i].sync()) real_frame_count--;
+			if(read_frame(i).sync()) real_frame_count--;
 		size_t current_pages = (frames + frames_per_page - 1) / frames_per_page;
 		size_t pages_needed = (newsize + frames_per_page - 1) / frames_per_page;
 		for(size_t i = pages_needed; i < current_pages; i++)
@@ -645,8 +675,11 @@ void frame_vector::resize(size_t newsize)
 		//Now zeroize the excess memory.
 		if(newsize < pages_needed * frames_per_page) {
 			size_t offset = frame_size * (newsize % frames_per_page);
-			memset(pages[pages_needed - 1].content + offset, 0, CONTROLLER_PAGE_SIZE - offset);
+			page& pg = pages[pages_needed - 1].write();
+			memset(pg.content + offset, 0, CONTROLLER_PAGE_SIZE - offset);
+			pg.syncs_valid = false;
 		}
+		invalidate_sync_index(pages_needed - 1);
 		frames = newsize;
 		call_framecount_notification(old_frame_count);
 	} else if(newsize > frames) {
@@ -681,32 +714,32 @@ bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_
 		return true;
 	//Scan both movies until frame syncs are seen. Out of bounds reads behave as all neutral but frame
 	//sync done.
-	uint64_t syncs_seen = 0;
-	uint64_t frames_read = 0;
 	size_t old_size = size();
 	size_t new_size = with.size();
-	size_t pagenum = 0;
 	size_t ocomplete_pages = old_size / frames_per_page;  //Round DOWN
 	size_t ncomplete_pages = new_size / frames_per_page;  //Round DOWN
 	size_t complete_pages = min(ocomplete_pages, ncomplete_pages);
-	while(syncs_seen + frames_per_page < nframe - 1 && pagenum < complete_pages) {
-		//Fast process page. The above condition guarantees that these pages are completely used.
-		auto opagedata = pages[pagenum].content;
-		auto npagedata = with.pages[pagenum].content;
-		size_t pagedataamt = frames_per_page * frame_size;
-		if(memcmp(opagedata, npagedata, pagedataamt))
+	//Complete pages ending before the sync starting the frame can be compared whole. If those are equal, so
+	//are the sync counts, which the sync index has.
+	update_sync_index();
+	size_t equal_pages = std::lower_bound(sync_index.begin() + 1, sync_index.begin() + 1 + complete_pages,
+		nframe - 1) - (sync_index.begin() + 1);
+	size_t pagedataamt = frames_per_page * frame_size;
+	for(size_t pagenum = 0; pagenum < equal_pages; pagenum++) {
+		//Pages still shared by copy-on-write are trivially equal.
+		auto opagedata = read_page(pagenum);
+		auto npagedata = with.read_page(pagenum);
+		if(opagedata != npagedata && memcmp(opagedata, npagedata, pagedataamt))
 			return false;
-		frames_read += frames_per_page;
-		pagenum++;
-		for(size_t i = 0; i < pagedataamt; i += frame_size)
-			if(opagedata[i] & 1) syncs_seen++;
 	}
+	uint64_t syncs_seen = sync_index[equal_pages];
+	uint64_t frames_read = equal_pages * frames_per_page;
 	while(syncs_seen < nframe - 1) {
 		frame oldc = blank_frame(true), newc = with.blank_frame(true);
 		if(frames_read < old_size)
-			oldc = (*this)[frames_read];
+			oldc = read_frame(frames_read);
 		if(frames_read < new_size)
-			newc = with[frames_read];
+			newc = with.read_frame(frames_read);
 		if(oldc != newc)
 			return false;	//Mismatch.
 		frames_read++;
@@ -729,9 +762,9 @@ bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_
 		short ov = 0, nv = 0;
 		for(uint32_t j = 0; j < p; j++) {
 			if(j < readable_old_subframes)
-				ov = (*this)[j + frames_read].axis2(i);
+				ov = read_frame(j + frames_read).axis2(i);
 			if(j < readable_new_subframes)
-				nv = with[j + frames_read].axis2(i);
+				nv = with.read_frame(j + frames_read).axis2(i);
 			if(ov != nv)
 				return false;
 		}
@@ -789,60 +822,54 @@ void frame_vector::swap_data(frame_vector& v) throw()
 	std::swap(cache_page_num, v.cache_page_num);
 	std::swap(cache_page, v.cache_page);
 	std::swap(real_frame_count, v.real_frame_count);
+	std::swap(sync_index, v.sync_index);
+	std::swap(sync_index_valid, v.sync_index_valid);
 	if(!freeze_count)
 		call_framecount_notification(toldsize);
 	if(!v.freeze_count)
 		v.call_framecount_notification(voldsize);
 }
 
+frame frame_vector::read_frame(size_t x) const
+{
+	size_t page = x / frames_per_page;
+	size_t pageoffset = frame_size * (x % frames_per_page);
+	if(x >= frames)
+		throw std::runtime_error("frame_vector::read_frame: Illegal index");
+	//The frame has no host, and must not be written to, as the page may be shared.
+	return frame(const_cast<unsigned char*>(read_page(page)) + pageoffset, *types);
+}
+
 int64_t frame_vector::find_frame(uint64_t n)
 {
 	if(!n) return -1;
+	update_sync_index();
+	//Find the page with the nth sync subframe, then scan that page.
+	auto i = std::lower_bound(sync_index.begin(), sync_index.end(), n);
+	if(i == sync_index.end()) return -1;
+	size_t pagenum = (i - sync_index.begin()) - 1;
+	n -= sync_index[pagenum];
 	uint64_t stride = get_stride();
 	uint64_t pageframes = get_frames_per_page();
-	uint64_t vsize = size();
-	size_t pagenum = 0;
-	while(vsize > 0) {
-		uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		for(unsigned i = 0; i < count; i++) {
-			if(frame::sync(content + offset)) n--;
-			if(n == 0) return (pagenum - 1) * pageframes + i;
-			offset += stride;
-		}
-		vsize -= count;
+	const unsigned char* content = read_page(pagenum);
+	uint64_t count = min(pageframes, (uint64_t)frames - pagenum * pageframes);
+	size_t offset = 0;
+	for(unsigned i = 0; i < count; i++) {
+		if(frame::sync(content + offset)) n--;
+		if(n == 0) return pagenum * pageframes + i;
+		offset += stride;
 	}
 	return -1;
 }
 
 int64_t frame_vector::subframe_to_frame(uint64_t n)
 {
-	int64_t ret = 1;
-	uint64_t stride = get_stride();
 	uint64_t pageframes = get_frames_per_page();
-	uint64_t vsize = size();
-	if(n >= vsize) return -1;
-	size_t pagenum = 0;
-	size_t cpage = n / pageframes;
-	for(uint64_t p = 0; p < cpage; p++) {
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		for(unsigned i = 0; i < pageframes; i++) {
-			if(frame::sync(content + offset)) ret++;
-			offset += stride;
-		}
-	}
-	{
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		unsigned idx = n % pageframes;
-		for(unsigned i = 0; i < idx; i++) {
-			if(frame::sync(content + offset)) ret++;
-			offset += stride;
-		}
-	}
-	return ret;
+	if(n >= size()) return -1;
+	update_sync_index();
+	size_t pagenum = n / pageframes;
+	const unsigned char* content = read_page(pagenum);
+	return 1 + sync_index[pagenum] + count_syncs(content, n % pageframes, get_stride());
 }
 
 frame::frame() throw()
@@ -0,0 +1,210 @@
+#include "rewindbuf.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	//Zero runs shorter than this are cheaper to store as part of literal.
+	const size_t min_zero_run = 8;
+
+	void write_varint(std::vector<char>& out, size_t v)
+	{
+		while(v >= 128) {
+			out.push_back(static_cast<char>((v & 127) | 128));
+			v >>= 7;
+		}
+		out.push_back(static_cast<char>(v));
+	}
+
+	size_t read_varint(const char*& p, const char* end)
+	{
+		size_t v = 0;
+		unsigned shift = 0;
+		while(true) {
+			if(p == end || shift >= 8 * sizeof(size_t))
+				throw std::runtime_error("Rewind buffer corrupt");
+			uint8_t b = *(p++);
+			v |= static_cast<size_t>(b & 127) << shift;
+			if(!(b & 128))
+				return v;
+			shift += 7;
+		}
+	}
+
+	inline uint64_t xor_word(const char* data, const char* ref, size_t off)
+	{
+		uint64_t a, b = 0;
+		memcpy(&a, data + off, 8);
+		if(ref)
+			memcpy(&b, ref + off, 8);
+		return a ^ b;
+	}
+
+	inline char xor_byte(const char* data, const char* ref, size_t off)
+	{
+		return ref ? (data[off] ^ ref[off]) : data[off];
+	}
+
+	//Find the end of zero run starting at off.
+	size_t scan_zero(const char* data, const char* ref, size_t off, size_t size)
+	{
+		while(off + 8 <= size && !xor_word(data, ref, off))
+			off += 8;
+		while(off < size && !xor_byte(data, ref, off))
+			off++;
+		return off;
+	}
+
+	//Find the end of literal run starting at off (start of next zero run long enough to be worth encoding).
+	size_t scan_literal(const char* data, const char* ref, size_t off, size_t size)
+	{
+		while(off < size) {
+			if(xor_byte(data, ref, off)) {
+				off++;
+				continue;
+			}
+			size_t zend = scan_zero(data, ref, off, size);
+			if(zend - off >= min_zero_run || zend == size)
+				return off;
+			off = zend;
+		}
+		return off;
+	}
+}
+
+rewind_buffer::rewind_buffer(size_t _budget, unsigned _keyframe_interval) throw()
+{
+	used = 0;
+	budget = _budget;
+	keyframe_interval = _keyframe_interval ? _keyframe_interval : 1;
+	since_keyframe = 0;
+}
+
+void rewind_buffer::encode(std::vector<char>& out, const char* data, const char* ref, size_t size)
+{
+	size_t off = 0;
+	while(off < size) {
+		size_t zend = scan_zero(data, ref, off, size);
+		if(zend == size)
+			break;
+		size_t lend = scan_literal(data, ref, zend, size);
+		write_varint(out, zend - off);
+		write_varint(out, lend - zend);
+		size_t base = out.size();
+		out.resize(base + (lend - zend));
+		char* o = &out[base];
+		if(ref)
+			for(size_t i = zend; i < lend; i++)
+				*(o++) = data[i] ^ ref[i];
+		else
+			memcpy(o, data + zend, lend - zend);
+		off = lend;
+	}
+}
+
+void rewind_buffer::decode_xor(char* target, size_t size, const char* enc, size_t encsize)
+{
+	const char* end = enc + encsize;
+	size_t off = 0;
+	while(enc < end) {
+		size_t zeroes = read_varint(enc, end);
+		size_t literal = read_varint(enc, end);
+		if(zeroes > size - off || literal > size - off - zeroes || literal > (size_t)(end - enc))
+			throw std::runtime_error("Rewind buffer corrupt");
+		off += zeroes;
+		for(size_t i = 0; i < literal; i++)
+			target[off + i] ^= enc[i];
+		off += literal;
+		enc += literal;
+	}
+}
+
+size_t rewind_buffer::set_limits(size_t _budget, unsigned _keyframe_interval)
+{
+	budget = _budget;
+	keyframe_interval = _keyframe_interval ? _keyframe_interval : 1;
+	return trim();
+}
+
+size_t rewind_buffer::push(const char* data, size_t size)
+{
+	entry e;
+	e.rawsize = size;
+	e.keyframe = (entries.empty() || top.size() != size || since_keyframe + 1 >= keyframe_interval);
+	e.data.reserve(size / 8);
+	encode(e.data, data, e.keyframe ? NULL : &top[0], size);
+	top.resize(size);
+	memcpy(&top[0], data, size);
+	since_keyframe = e.keyframe ? 0 : since_keyframe + 1;
+	used += e.data.size();
+	entries.push_back(entry());
+	entries.back().data.swap(e.data);
+	entries.back().rawsize = e.rawsize;
+	entries.back().keyframe = e.keyframe;
+	return trim();
+}
+
+bool rewind_buffer::pop(std::vector<char>& out)
+{
+	if(entries.empty())
+		return false;
+	out.resize(top.size());
+	memcpy(&out[0], &top[0], top.size());
+	entry& e = entries.back();
+	bool was_keyframe = e.keyframe;
+	if(!was_keyframe)
+		decode_xor(&top[0], top.size(), e.data.data(), e.data.size());
+	used -= e.data.size();
+	entries.pop_back();
+	if(was_keyframe)
+		rebuild_top();
+	else
+		since_keyframe--;
+	return true;
+}
+
+void rewind_buffer::clear() throw()
+{
+	entries.clear();
+	std::vector<char> tmp;
+	top.swap(tmp);
+	used = 0;
+	since_keyframe = 0;
+}
+
+void rewind_buffer::rebuild_top()
+{
+	//Replay forward from the nearest keyframe.
+	if(entries.empty()) {
+		top.clear();
+		since_keyframe = 0;
+		return;
+	}
+	size_t k = entries.size() - 1;
+	while(!entries[k].keyframe)
+		k--;
+	top.resize(entries[k].rawsize);
+	memset(&top[0], 0, top.size());
+	for(size_t i = k; i < entries.size(); i++)
+		decode_xor(&top[0], top.size(), entries[i].data.data(), entries[i].data.size());
+	since_keyframe = entries.size() - 1 - k;
+}
+
+size_t rewind_buffer::trim()
+{
+	size_t dropped = 0;
+	while(used > budget) {
+		//Drop the whole bottom keyframe group, but never the group that the top snapshot is in.
+		size_t glen = 1;
+		while(glen < entries.size() && !entries[glen].keyframe)
+			glen++;
+		if(glen == entries.size())
+			break;
+		for(size_t i = 0; i < glen; i++) {
+			used -= entries.front().data.size();
+			entries.pop_front();
+		}
+		dropped += glen;
+	}
+	return dropped;
+}
@@ -5,9 +5,10 @@
 #include <iostream>
 #include <iomanip>
 #include "arch-detect.hpp"
+#include "cpu-features.hpp"
 
-//Since this isn't used for anything too performance-sensitive, just write a implementation, no need to specially
-//optimize.
+//Savestates are hashed on every save and load, so whole blocks are compressed straight from the input, using the
+//SHA extensions if the CPU has those.
 
 namespace
 {
@@ -107,7 +108,8 @@ namespace
 	ROUND(b, c, d, e, f, g, h, a, i, 7)
 
 
-	void compress_sha256(uint32_t* state, uint32_t* datablock, unsigned& blockbytes)
+	//Compress one block. Overwrites datablock with message schedule.
+	void compress_block(uint32_t* state, uint32_t* datablock)
 	{
 		uint32_t a = state[0];
 		uint32_t b = state[1];
@@ -134,9 +136,92 @@ namespace
 		state[5] += f;
 		state[6] += g;
 		state[7] += h;
+	}
+
+	void compress_sha256(uint32_t* state, uint32_t* datablock, unsigned& blockbytes)
+	{
+		compress_block(state, datablock);
 		memset(datablock, 0, 64);
 		blockbytes = 0;
 	}
+
+	void compress_blocks_generic(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		uint32_t datablock[16];
+		for(size_t i = 0; i < blocks; i++) {
+			for(unsigned j = 0; j < 16; j++) {
+				const uint8_t* w = data + 64 * i + 4 * j;
+#ifdef ARCH_IS_I386
+				uint32_t x;
+				memcpy(&x, w, 4);
+				asm("bswap %0" : "+r"(x));
+				datablock[j] = x;
+#else
+				datablock[j] = (static_cast<uint32_t>(w[0]) << 24) | (static_cast<uint32_t>(w[1]) << 16) |
+					(static_cast<uint32_t>(w[2]) << 8) | w[3];
+#endif
+			}
+			compress_block(state, datablock);
+		}
+	}
+}
+
+#ifdef ARCH_HAS_I386_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sha,sse4.1")
+#include <immintrin.h>
+namespace
+{
+	void compress_blocks_shani(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		//The instructions want the state as ABEF and CDGH.
+		__m128i t = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+		__m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+		__m128i s0 = _mm_alignr_epi8(t, s1, 8);
+		s1 = _mm_blend_epi16(s1, t, 0xF0);
+		for(size_t i = 0; i < blocks; i++) {
+			__m128i s0_save = s0;
+			__m128i s1_save = s1;
+			__m128i m[4];
+			for(unsigned j = 0; j < 4; j++)
+				m[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 64 * i +
+					16 * j)), bswap);
+			for(unsigned r = 0; r < 16; r++) {
+				__m128i msg = _mm_add_epi32(m[r & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(k +
+					4 * r)));
+				s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+				//Expand the words for rounds 4 groups ahead into the slot just consumed.
+				if(r < 12)
+					m[r & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m[r & 3],
+						m[(r + 1) & 3]), _mm_alignr_epi8(m[(r + 3) & 3], m[(r + 2) & 3], 4)),
+						m[(r + 3) & 3]);
+				s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0E));
+			}
+			s0 = _mm_add_epi32(s0, s0_save);
+			s1 = _mm_add_epi32(s1, s1_save);
+		}
+		t = _mm_shuffle_epi32(s0, 0x1B);
+		s1 = _mm_shuffle_epi32(s1, 0xB1);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(t, s1, 0xF0));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(s1, t, 8));
+	}
+}
+#pragma GCC pop_options
+#endif
+
+namespace
+{
+	typedef void (*compress_blocks_fn)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+	compress_blocks_fn select_compress_blocks()
+	{
+#ifdef ARCH_HAS_I386_INTRINSICS
+		if(cpu_features::sha() && cpu_features::sse41())
+			return compress_blocks_shani;
+#endif
+		return compress_blocks_generic;
+	}
 }
 
 void sha256::real_init()
@@ -168,45 +253,29 @@ void sha256::real_finish(uint8_t* hash)
 
 void sha256::real_write(const uint8_t* data, size_t datalen)
 {
-#ifdef ARCH_IS_I386
-	//First pad blockbytes to multiple of four.
 	size_t i = 0;
-	while(blockbytes & 3 && i < datalen) {
+	//First fill up partial block.
+	while(blockbytes && i < datalen) {
 		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
 		blockbytes++;
 		if(blockbytes == 64)
 			compress_sha256(state, datablock, blockbytes);
 		i++;
 	}
-	size_t blocks = (datalen - i) / 4;
-	unsigned ptr = blockbytes / 4;
-	//Then process four bytes ata time.
-	for(size_t j = 0; j < blocks; j++) {
-		uint32_t x = *reinterpret_cast<const uint32_t*>(data + i);
-		asm("bswap %0" : "+r"(x));
-		datablock[ptr] = x;
-		ptr = (ptr + 1) & 15;
-		i += 4;
-		blockbytes += 4;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
+	//Then compress whole blocks directly from data.
+	size_t blocks = (datalen - i) / 64;
+	if(blocks) {
+		//Savestates are hashed on the writer thread too, so the selection must be thread-safe.
+		static compress_blocks_fn compress_blocks = select_compress_blocks();
+		compress_blocks(state, data + i, blocks);
+		i += 64 * blocks;
 	}
 	//And finally process tail.
 	while(i < datalen) {
 		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
 		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
 		i++;
 	}
-#else
-	for(size_t i = 0; i < datalen; i++) {
-		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
-		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
-	}
-#endif
 	totalbytes += datalen;
 }
 
@@ -0,0 +1,254 @@
+#include "lua/internal.hpp"
+#include "lua/unsaferewind.hpp"
+#include "core/botfarm.hpp"
+#include "core/command.hpp"
+#include "core/instance.hpp"
+#include "core/misc.hpp"
+#include "core/moviedata.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "library/directory.hpp"
+
+namespace
+{
+	settingvar::supervariable<settingvar::model_path> SET_botfarm_worker(lsnes_setgrp, "botfarm-worker",
+		"Lua‣Bot farm worker program", "lsnes-dumpavi");
+
+	void push_state(lua::state& L, const std::vector<char>& state)
+	{
+		if(state.empty()) {
+			L.pushnil();
+			return;
+		}
+		lua_unsaferewind* u = lua::_class<lua_unsaferewind>::create(L);
+		u->unserialize(&state[0], state.size());
+	}
+
+	void read_state(lua::parameters& P, std::vector<char>& state)
+	{
+		if(P.is_novalue())
+			return;
+		lua::objpin<lua_unsaferewind> pin;
+		P(pin);
+		pin->serialize(state);
+	}
+
+	class lua_botfarm
+	{
+	public:
+		lua_botfarm(lua::state& L, unsigned workers, const std::string& script, const std::string& movie,
+			const std::string& log, bool _temporary);
+		static size_t overcommit(unsigned workers, const std::string& script, const std::string& movie,
+			const std::string& log, bool temporary) { return 0; }
+		~lua_botfarm()
+		{
+			close_farm();
+		}
+		static int create(lua::state& L, lua::parameters& P);
+		int submit(lua::state& L, lua::parameters& P);
+		int poll(lua::state& L, lua::parameters& P);
+		int wait(lua::state& L, lua::parameters& P);
+		int pending(lua::state& L, lua::parameters& P);
+		int workers(lua::state& L, lua::parameters& P);
+		int close(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			if(!farm)
+				return "closed";
+			return (stringfmt() << farm->workers() << " workers, " << farm->pending() << " pending").str();
+		}
+	private:
+		void close_farm();
+		int collect(lua::state& L, int timeout);
+		botfarm_coordinator* farm;
+		std::string movie;
+		bool temporary;
+	};
+
+	lua::_class<lua_botfarm> LUA_class_botfarm(lua_class_movie, "BOTFARM", {
+		{"new", lua_botfarm::create},
+	}, {
+		{"submit", &lua_botfarm::submit},
+		{"poll", &lua_botfarm::poll},
+		{"wait", &lua_botfarm::wait},
+		{"pending", &lua_botfarm::pending},
+		{"workers", &lua_botfarm::workers},
+		{"close", &lua_botfarm::close},
+	}, &lua_botfarm::print);
+
+	lua_botfarm::lua_botfarm(lua::state& L, unsigned workers, const std::string& script,
+		const std::string& _movie, const std::string& log, bool _temporary)
+	{
+		movie = _movie;
+		temporary = _temporary;
+		farm = NULL;
+		std::vector<std::string> argv;
+		argv.push_back(SET_botfarm_worker(*CORE().settings));
+		argv.push_back("--worker");
+		//Workers would otherwise look for the ROM by the hints in the movie.
+		for(auto& i : active_rom_arguments())
+			argv.push_back(i);
+		argv.push_back("--lua=" + script);
+		argv.push_back(movie);
+		try {
+			farm = new botfarm_coordinator(workers, argv, log);
+		} catch(...) {
+			if(temporary)
+				remove(movie.c_str());
+			throw;
+		}
+	}
+
+	void lua_botfarm::close_farm()
+	{
+		delete farm;
+		farm = NULL;
+		if(temporary)
+			remove(movie.c_str());
+		temporary = false;
+	}
+
+	int lua_botfarm::create(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		unsigned workers;
+		std::string script, movie, log;
+
+		P(workers, script, P.optional(movie, ""), P.optional(log, ""));
+
+		if(!workers)
+			throw std::runtime_error("Bot farm needs at least one worker");
+		//Workers must not depend on the current directory of this process for the script.
+		script = directory::absolute_path(script);
+		bool temporary = false;
+		if(movie == "") {
+			//Workers start from the current movie.
+			if(!*core.mlogic)
+				throw std::runtime_error("No movie loaded");
+			movie = get_temp_file();
+			temporary = true;
+			try {
+				core.mlogic->get_mfile().save(movie, 0, true, core.mlogic->get_rrdata(), false);
+			} catch(...) {
+				remove(movie.c_str());
+				throw;
+			}
+		}
+		lua::_class<lua_botfarm>::create(L, workers, script, movie, log, temporary);
+		return 1;
+	}
+
+	int lua_botfarm::submit(lua::state& L, lua::parameters& P)
+	{
+		std::string data;
+		std::vector<char> state;
+
+		if(!farm) throw std::runtime_error("Bot farm already closed");
+
+		P(P.skipped(), data);
+		read_state(P, state);
+
+		L.pushnumber(farm->submit(data, state));
+		return 1;
+	}
+
+	int lua_botfarm::collect(lua::state& L, int timeout)
+	{
+		std::list<botfarm_message> results;
+		if(!farm) throw std::runtime_error("Bot farm already closed");
+		farm->poll(results, timeout);
+		L.newtable();
+		size_t idx = 1;
+		for(auto& i : results) {
+			L.pushnumber(idx++);
+			L.newtable();
+			L.pushstring("id");
+			L.pushnumber(i.id);
+			L.rawset(-3);
+			if(i.error != "") {
+				L.pushstring("error");
+				L.pushlstring(i.error);
+				L.rawset(-3);
+			} else {
+				L.pushstring("data");
+				L.pushlstring(i.data);
+				L.rawset(-3);
+				L.pushstring("state");
+				push_state(L, i.state);
+				L.rawset(-3);
+			}
+			L.rawset(-3);
+		}
+		return 1;
+	}
+
+	int lua_botfarm::poll(lua::state& L, lua::parameters& P)
+	{
+		return collect(L, 0);
+	}
+
+	int lua_botfarm::wait(lua::state& L, lua::parameters& P)
+	{
+		int timeout;
+
+		P(P.skipped(), P.optional(timeout, -1));
+
+		return collect(L, timeout);
+	}
+
+	int lua_botfarm::pending(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(farm ? farm->pending() : 0);
+		return 1;
+	}
+
+	int lua_botfarm::workers(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(farm ? farm->workers() : 0);
+		return 1;
+	}
+
+	int lua_botfarm::close(lua::state& L, lua::parameters& P)
+	{
+		close_farm();
+		return 0;
+	}
+
+	int get_job(lua::state& L, lua::parameters& P)
+	{
+		botfarm_message job;
+		if(!botfarm_worker_get_job(job)) {
+			//Coordinator has gone away, nothing more to do.
+			CORE().command->invoke("quit-emulator");
+			L.pushnil();
+			return 1;
+		}
+		L.pushnumber(job.id);
+		L.pushlstring(job.data);
+		push_state(L, job.state);
+		return 3;
+	}
+
+	int put_result(lua::state& L, lua::parameters& P)
+	{
+		botfarm_message result;
+
+		P(result.id, result.data);
+		read_state(P, result.state);
+
+		botfarm_worker_put_result(result);
+		return 0;
+	}
+
+	int is_worker(lua::state& L, lua::parameters& P)
+	{
+		L.pushboolean(botfarm_is_worker());
+		return 1;
+	}
+
+	lua::functions LUA_botfarm_fns(lua_func_misc, "botfarm", {
+		{"get_job", get_job},
+		{"put_result", put_result},
+		{"is_worker", is_worker},
+	});
+}
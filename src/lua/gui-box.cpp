@@ -6,15 +6,14 @@
 
 namespace
 {
-	struct render_object_box : public framebuffer::object
+	struct box_item
 	{
-		render_object_box(int32_t _x, int32_t _y, int32_t _width, int32_t _height,
+		box_item(int32_t _x, int32_t _y, int32_t _width, int32_t _height,
 			framebuffer::color _outline1, framebuffer::color _outline2, framebuffer::color _fill,
 			int32_t _thickness) throw()
 			: x(_x), y(_y), width(_width), height(_height), outline1(_outline1), outline2(_outline2),
 			fill(_fill), thickness(_thickness) {}
-		~render_object_box() throw() {}
-		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		template<bool X> void draw(struct framebuffer::fb<X>& scr) throw()
 		{
 			uint32_t oX = x + scr.get_origin_x();
 			uint32_t oY = y + scr.get_origin_y();
@@ -33,9 +32,6 @@ namespace
 						fill.apply(rptr[eptr]);
 			}
 		}
-		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
-		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
-		void clone(framebuffer::queue& q) const { q.clone_helper(this); }
 	private:
 		int32_t x;
 		int32_t y;
@@ -59,8 +55,8 @@ namespace
 		P(x, y, width, height, P.optional(thickness, 1), P.optional(poutline1, 0xFFFFFFU),
 			P.optional(poutline2, 0x808080U), P.optional(pfill, 0xC0C0C0U));
 
-		core.lua2->render_ctx->queue->create_add<render_object_box>(x, y, width, height, poutline1, poutline2,
-			pfill, thickness);
+		core.lua2->render_ctx->queue->batch_add(box_item(x, y, width, height, poutline1, poutline2, pfill,
+			thickness));
 		return 0;
 	}
 
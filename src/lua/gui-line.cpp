@@ -5,13 +5,11 @@
 
 namespace
 {
-	struct render_object_line : public framebuffer::object
+	struct line_item
 	{
-		render_object_line(int32_t _x1, int32_t _x2, int32_t _y1, int32_t _y2, framebuffer::color _color)
-			throw()
+		line_item(int32_t _x1, int32_t _x2, int32_t _y1, int32_t _y2, framebuffer::color _color) throw()
 			: x1(_x1), y1(_y1), x2(_x2), y2(_y2), color(_color) {}
-		~render_object_line() throw() {}
-		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		template<bool X> void draw(struct framebuffer::fb<X>& scr) throw()
 		{
 			size_t swidth = scr.get_width();
 			size_t sheight = scr.get_height();
@@ -79,9 +77,6 @@ nodraw2:
 				}
 			}
 		}
-		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
-		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
-		void clone(framebuffer::queue& q) const { q.clone_helper(this); }
 	private:
 		int32_t x1;
 		int32_t y1;
@@ -100,7 +95,7 @@ nodraw2:
 
 		P(x1, y1, x2, y2, P.optional(pcolor, 0xFFFFFFU));
 
-		core.lua2->render_ctx->queue->create_add<render_object_line>(x1, x2, y1, y2, pcolor);
+		core.lua2->render_ctx->queue->batch_add(line_item(x1, x2, y1, y2, pcolor));
 		return 0;
 	}
 
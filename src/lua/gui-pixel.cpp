@@ -5,12 +5,12 @@
 
 namespace
 {
-	struct render_object_pixel : public framebuffer::object
+	//Pixels are drawn in batches, as scripts may draw thousands of them.
+	struct pixel_item
 	{
-		render_object_pixel(int32_t _x, int32_t _y, framebuffer::color _color) throw()
+		pixel_item(int32_t _x, int32_t _y, framebuffer::color _color) throw()
 			: x(_x), y(_y), color(_color) {}
-		~render_object_pixel() throw() {}
-		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		template<bool X> void draw(struct framebuffer::fb<X>& scr) throw()
 		{
 			int32_t _x = x + scr.get_origin_x();
 			int32_t _y = y + scr.get_origin_y();
@@ -20,9 +20,6 @@ namespace
 				return;
 			color.apply(scr.rowptr(_y)[_x]);
 		}
-		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
-		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
-		void clone(framebuffer::queue& q) const { q.clone_helper(this); }
 	private:
 		int32_t x;
 		int32_t y;
@@ -39,7 +36,7 @@ namespace
 
 		P(x, y, P.optional(pcolor, 0xFFFFFFU));
 
-		core.lua2->render_ctx->queue->create_add<render_object_pixel>(x, y, pcolor);
+		core.lua2->render_ctx->queue->batch_add(pixel_item(x, y, pcolor));
 		return 0;
 	}
 
@@ -6,14 +6,13 @@
 
 namespace
 {
-	struct render_object_rectangle : public framebuffer::object
+	struct rectangle_item
 	{
-		render_object_rectangle(int32_t _x, int32_t _y, int32_t _width, int32_t _height,
+		rectangle_item(int32_t _x, int32_t _y, int32_t _width, int32_t _height,
 			framebuffer::color _outline, framebuffer::color _fill, int32_t _thickness) throw()
 			: x(_x), y(_y), width(_width), height(_height), outline(_outline), fill(_fill),
 			thickness(_thickness) {}
-		~render_object_rectangle() throw() {}
-		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		template<bool X> void draw(struct framebuffer::fb<X>& scr) throw()
 		{
 			uint32_t oX = x + scr.get_origin_x();
 			uint32_t oY = y + scr.get_origin_y();
@@ -30,9 +29,6 @@ namespace
 						fill.apply(rptr[eptr]);
 			}
 		}
-		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
-		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
-		void clone(framebuffer::queue& q) const { q.clone_helper(this); }
 	private:
 		int32_t x;
 		int32_t y;
@@ -55,8 +51,8 @@ namespace
 		P(x, y, width, height, P.optional(thickness, 1), P.optional(poutline, 0xFFFFFFU),
 			P.optional(pfill, -1));
 
-		core.lua2->render_ctx->queue->create_add<render_object_rectangle>(x, y, width, height, poutline,
-			pfill, thickness);
+		core.lua2->render_ctx->queue->batch_add(rectangle_item(x, y, width, height, poutline, pfill,
+			thickness));
 		return 0;
 	}
 
@@ -71,8 +67,7 @@ namespace
 
 		P(x, y, width, height, P.optional(pcolor, 0xFFFFFFU));
 
-		core.lua2->render_ctx->queue->create_add<render_object_rectangle>(x, y, width, height, pcolor, pcolor,
-			0);
+		core.lua2->render_ctx->queue->batch_add(rectangle_item(x, y, width, height, pcolor, pcolor, 0));
 		return 0;
 	}
 
@@ -392,8 +392,9 @@ namespace
 			while(vsize > 0) {
 				uint64_t count = (vsize > pageframes) ? pageframes : vsize;
 				size_t bytes = count * stride;
-				unsigned char* content = v.get_page_buffer(pagenum++);
-				file.write(reinterpret_cast<char*>(content), bytes);
+				const unsigned char* content = static_cast<const portctrl::frame_vector&>(v).get_page_buffer(
+					pagenum++);
+				file.write(reinterpret_cast<const char*>(content), bytes);
 				vsize -= count;
 			}
 		} else {
@@ -13,6 +13,7 @@
 #include "core/memorymanip.hpp"
 #include "core/moviedata.hpp"
 #include "core/misc.hpp"
+#include "library/serialization.hpp"
 
 #include <map>
 #include <cstring>
@@ -497,6 +498,110 @@ lua_unsaferewind::lua_unsaferewind(lua::state& L)
 {
 }
 
+namespace
+{
+	void put_u64(std::vector<char>& out, uint64_t v)
+	{
+		char buf[8];
+		serialization::u64l(buf, v);
+		out.insert(out.end(), buf, buf + 8);
+	}
+
+	void put_blob(std::vector<char>& out, const char* data, size_t size)
+	{
+		put_u64(out, size);
+		out.insert(out.end(), data, data + size);
+	}
+
+	uint64_t get_u64(const char*& in, const char* end)
+	{
+		if(end - in < 8)
+			throw std::runtime_error("Rewind point truncated");
+		uint64_t v = serialization::u64l(in);
+		in += 8;
+		return v;
+	}
+
+	const char* get_blob(const char*& in, const char* end, size_t& size)
+	{
+		uint64_t s = get_u64(in, end);
+		if(s > (uint64_t)(end - in))
+			throw std::runtime_error("Rewind point truncated");
+		const char* r = in;
+		size = s;
+		in += s;
+		return r;
+	}
+}
+
+void lua_unsaferewind::serialize(std::vector<char>& out)
+{
+	dynamic_state& d = console_state;
+	out.clear();
+	put_u64(out, d.save_frame);
+	put_u64(out, d.lagged_frames);
+	put_u64(out, ptr);
+	put_u64(out, d.poll_flag);
+	put_u64(out, d.rtc_second);
+	put_u64(out, d.rtc_subsecond);
+	put_u64(out, d.pollcounters.size());
+	for(auto i : d.pollcounters)
+		put_u64(out, i);
+	put_blob(out, d.savestate.data(), d.savestate.size());
+	put_blob(out, d.host_memory.data(), d.host_memory.size());
+	put_u64(out, d.sram.size());
+	for(auto& i : d.sram) {
+		put_blob(out, i.first.data(), i.first.size());
+		put_blob(out, i.second.data(), i.second.size());
+	}
+	put_u64(out, d.active_macros.size());
+	for(auto& i : d.active_macros) {
+		put_blob(out, i.first.data(), i.first.size());
+		put_u64(out, i.second);
+	}
+}
+
+void lua_unsaferewind::unserialize(const char* in, size_t insize)
+{
+	const char* end = in + insize;
+	dynamic_state d;
+	size_t s;
+	const char* p;
+	d.save_frame = get_u64(in, end);
+	d.lagged_frames = get_u64(in, end);
+	uint64_t _ptr = get_u64(in, end);
+	d.poll_flag = get_u64(in, end);
+	d.rtc_second = get_u64(in, end);
+	d.rtc_subsecond = get_u64(in, end);
+	uint64_t n = get_u64(in, end);
+	if(n > (uint64_t)(end - in) / 8)
+		throw std::runtime_error("Rewind point truncated");
+	d.pollcounters.resize(n);
+	for(uint64_t i = 0; i < n; i++)
+		d.pollcounters[i] = get_u64(in, end);
+	p = get_blob(in, end, s);
+	d.savestate.assign(p, p + s);
+	p = get_blob(in, end, s);
+	d.host_memory.assign(p, p + s);
+	n = get_u64(in, end);
+	for(uint64_t i = 0; i < n; i++) {
+		p = get_blob(in, end, s);
+		std::string name(p, p + s);
+		p = get_blob(in, end, s);
+		d.sram[name].assign(p, p + s);
+	}
+	n = get_u64(in, end);
+	for(uint64_t i = 0; i < n; i++) {
+		p = get_blob(in, end, s);
+		std::string name(p, p + s);
+		d.active_macros[name] = get_u64(in, end);
+	}
+	if(in != end)
+		throw std::runtime_error("Junk after rewind point");
+	console_state.swap(d);
+	ptr = _ptr;
+}
+
 void lua_state::run_startup_scripts()
 {
 	for(auto i : startup_scripts) {
@@ -0,0 +1,191 @@
+#include "lua/internal.hpp"
+#include "core/instance.hpp"
+#include "core/memorymanip.hpp"
+#include "library/memoryspace.hpp"
+#include "library/serialization.hpp"
+#include "library/int24.hpp"
+
+namespace
+{
+	//Elements are stored little-endian, so string() gives the same bytes regardless of host and VMA.
+	template<typename T> void read_elem(memory_space& m, uint64_t addr, uint8_t* out)
+	{
+		serialization::write_endian<T>(out, m.read<T>(addr), -1);
+	}
+
+	template<typename T> void copy_elem(uint8_t* out, const char* in, int endian)
+	{
+		serialization::write_endian<T>(out, serialization::read_endian<T>(in, endian), -1);
+	}
+
+	template<typename T> void push_elem(lua::state& L, const uint8_t* in)
+	{
+		L.pushnumber(static_cast<T>(serialization::read_endian<T>(in, -1)));
+	}
+
+	struct array_type
+	{
+		const char* name;
+		size_t width;
+		void (*read)(memory_space& m, uint64_t addr, uint8_t* out);
+		void (*copy)(uint8_t* out, const char* in, int endian);
+		void (*push)(lua::state& L, const uint8_t* in);
+	};
+
+#define ARRAY_TYPE(name, T) {name, sizeof(T), read_elem<T>, copy_elem<T>, push_elem<T>}
+	const array_type array_types[] = {
+		ARRAY_TYPE("byte", uint8_t),
+		ARRAY_TYPE("sbyte", int8_t),
+		ARRAY_TYPE("word", uint16_t),
+		ARRAY_TYPE("sword", int16_t),
+		ARRAY_TYPE("hword", ss_uint24_t),
+		ARRAY_TYPE("shword", ss_int24_t),
+		ARRAY_TYPE("dword", uint32_t),
+		ARRAY_TYPE("sdword", int32_t),
+		ARRAY_TYPE("qword", uint64_t),
+		ARRAY_TYPE("sqword", int64_t),
+		ARRAY_TYPE("float", float),
+		ARRAY_TYPE("double", double),
+	};
+#undef ARRAY_TYPE
+
+	const array_type& lookup_type(const std::string& name)
+	{
+		for(auto& i : array_types)
+			if(name == i.name)
+				return i;
+		throw std::runtime_error("Unknown element type '" + name + "'");
+	}
+
+	class memory_array
+	{
+	public:
+		memory_array(lua::state& L, uint64_t addr, uint64_t count, const array_type* type, uint64_t stride);
+		static size_t overcommit(uint64_t addr, uint64_t count, const array_type* type, uint64_t stride)
+		{
+			return lua::overcommit_std_align + (size_t)count * type->width;
+		}
+		static int create(lua::state& L, lua::parameters& P);
+		int index(lua::state& L, lua::parameters& P);
+		int len(lua::state& L, lua::parameters& P);
+		int refresh(lua::state& L, lua::parameters& P);
+		int string(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			std::ostringstream x;
+			x << "addr=0x" << std::hex << addr << " count=" << std::dec << count << " type=" << type->name
+				<< " stride=0x" << std::hex << stride;
+			return x.str();
+		}
+	private:
+		void fill();
+		uint8_t* data;
+		const array_type* type;
+		uint64_t addr;
+		uint64_t count;
+		uint64_t stride;
+	};
+
+	memory_array::memory_array(lua::state& L, uint64_t _addr, uint64_t _count, const array_type* _type,
+		uint64_t _stride)
+	{
+		if(_count && (((size_t)_count * _type->width) + lua::overcommit_std_align) / _count < _type->width)
+			throw std::runtime_error("Array too large");
+		addr = _addr;
+		count = _count;
+		type = _type;
+		stride = _stride;
+		data = lua::align_overcommit<memory_array, uint8_t>(this);
+		memset(data, 0, (size_t)count * type->width);
+	}
+
+	void memory_array::fill()
+	{
+		if(!count)
+			return;
+		auto& core = CORE();
+		size_t w = type->width;
+		//Whole array inside one directly mapped VMA: skip the per-element lookups.
+		uint64_t span = (count - 1) * stride + w;
+		bool overflow = (count > 1 && ((count - 1) * stride) / (count - 1) != stride) || span < w ||
+			addr + span < addr;
+		auto g = core.memory->lookup(addr);
+		if(!overflow && g.first && g.first->direct_map && span <= g.first->size &&
+			g.second <= g.first->size - span) {
+			const char* src = reinterpret_cast<const char*>(g.first->direct_map + g.second);
+			int endian = g.first->endian;
+			for(uint64_t i = 0; i < count; i++)
+				type->copy(data + i * w, src + i * stride, endian);
+		} else {
+			for(uint64_t i = 0; i < count; i++)
+				type->read(*core.memory, addr + i * stride, data + i * w);
+		}
+	}
+
+	int memory_array::create(lua::state& L, lua::parameters& P)
+	{
+		uint64_t addr, count, stride;
+		std::string tname;
+
+		addr = lua_get_read_address(P);
+		P(count, tname);
+		const array_type& type = lookup_type(tname);
+		P(P.optional(stride, type.width));
+
+		memory_array* o = lua::_class<memory_array>::create(L, addr, count, &type, stride);
+		o->fill();
+		return 1;
+	}
+
+	int memory_array::index(lua::state& L, lua::parameters& P)
+	{
+		if(P.is_number(2)) {
+			uint64_t i;
+			P(P.skipped(), i);
+			if(i < count)
+				type->push(L, data + i * type->width);
+			else
+				L.pushnil();
+			return 1;
+		}
+		//Not an element, look up a method.
+		L.getmetatable(1);
+		L.pushvalue(2);
+		L.rawget(-2);
+		if(L.type(-1) == LUA_TNIL)
+			throw std::runtime_error(std::string("Class 'MEMORY_ARRAY' does not have class method '") +
+				(L.type(2) == LUA_TSTRING ? L.tostring(2) : "?") + "'");
+		return 1;
+	}
+
+	int memory_array::len(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(count);
+		return 1;
+	}
+
+	int memory_array::refresh(lua::state& L, lua::parameters& P)
+	{
+		P(P.skipped());
+		if(!P.is_novalue())
+			addr = lua_get_read_address(P);
+		fill();
+		return 0;
+	}
+
+	int memory_array::string(lua::state& L, lua::parameters& P)
+	{
+		L.pushlstring(reinterpret_cast<const char*>(data), (size_t)count * type->width);
+		return 1;
+	}
+
+	lua::_class<memory_array> LUA_class_memory_array(lua_class_memory, "MEMORY_ARRAY", {
+		{"new", memory_array::create},
+	}, {
+		{"__index", &memory_array::index},
+		{"__len", &memory_array::len},
+		{"size", &memory_array::len},
+		{"refresh", &memory_array::refresh},
+		{"string", &memory_array::string},
+	}, &memory_array::print);
+}
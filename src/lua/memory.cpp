@@ -638,9 +638,11 @@ namespace
 	int hash_state(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
-		auto x = core.rom->save_core_state();
-		size_t offset = x.size() - 32;
-		L.pushlstring(hex::b_to((uint8_t*)&x[offset], 32));
+		//The savestate trailer may hold the fast checksum, so hash the state separately.
+		auto x = core.rom->save_core_state(true);
+		uint8_t tmp[32];
+		sha256::hash(tmp, x);
+		L.pushlstring(hex::b_to(tmp, 32));
 		return 1;
 	}
 
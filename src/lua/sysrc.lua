@@ -76,7 +76,9 @@ callback=classes.CALLBACKS_LIST.new();
 memory.mkaddr = classes.ADDRESS.new;
 memory.map_structure=classes.MMAP_STRUCT.new;
 memory.compare_new=classes.COMPARE_OBJ.new;
+memory.readarray=classes.MEMORY_ARRAY.new;
 zip.create=classes.ZIPWRITER.new;
+botfarm.new=classes.BOTFARM.new;
 gui.tilemap=classes.TILEMAP.new;
 gui.renderq_new=classes.RENDERCTX.new;
 gui.palette_new=classes.PALETTE.new;
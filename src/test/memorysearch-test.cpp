@@ -0,0 +1,70 @@
+#include "memoryspace.hpp"
+#include "memorysearch.hpp"
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+struct test
+{
+	const char* name;
+	std::function<bool()> run;
+};
+
+//Searches a 200-byte region where every byte changes from oldv to newv. Long enough for the whole-word paths,
+//with a per-address tail.
+uint64_t search_changed(uint8_t oldv, uint8_t newv, std::function<void(memory_search&)> fn)
+{
+	static unsigned char mem[200];
+	memory_space space;
+	memory_space::region_direct r("test", 0, -1, mem, sizeof(mem));
+	std::list<memory_space::region*> regions;
+	regions.push_back(&r);
+	space.set_regions(regions);
+	memory_search s(space);
+	memset(mem, oldv, sizeof(mem));
+	s.reset();
+	memset(mem, newv, sizeof(mem));
+	fn(s);
+	return s.get_candidate_count();
+}
+
+struct test tests[] = {
+	{"u8 negative difference", []() {
+		return search_changed(10, 9, [](memory_search& s) { s.s_difference<uint8_t>(255); }) == 0;
+	}},{"u16 negative difference", []() {
+		return search_changed(10, 9, [](memory_search& s) { s.s_difference<uint16_t>(0xFEFF); }) == 0;
+	}},{"s8 negative difference", []() {
+		return search_changed(10, 9, [](memory_search& s) { s.s_difference<int8_t>(-1); }) == 200;
+	}},{"u8 positive difference", []() {
+		return search_changed(9, 10, [](memory_search& s) { s.s_difference<uint8_t>(1); }) == 200;
+	}},{"u16 positive difference", []() {
+		return search_changed(9, 10, [](memory_search& s) { s.s_difference<uint16_t>(0x101); }) == 199;
+	}},{"u32 negative difference", []() {
+		return search_changed(10, 9, [](memory_search& s) { s.s_difference<uint32_t>(0xFEFEFEFFU); }) ==
+			197;
+	}},{NULL, std::function<bool()>()}
+};
+
+int main()
+{
+	struct test* t = tests;
+	while(t->name) {
+		std::cout << t->name << "..." << std::flush;
+		try {
+			if(t->run())
+				std::cout << "\e[32mPASS\e[0m" << std::endl;
+			else {
+				std::cout << "\e[31mFAILED\e[0m" << std::endl;
+				return 1;
+			}
+		} catch(std::exception& e) {
+			std::cout << "\e[31mEXCEPTION: " << e.what() << "\e[0m" << std::endl;
+			return 1;
+		} catch(...) {
+			std::cout << "\e[31mUNKNOWN EXCEPTION\e[0m" << std::endl;
+			return 1;
+		}
+		t++;
+	}
+	return 0;
+}
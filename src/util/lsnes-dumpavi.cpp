@@ -1,6 +1,7 @@
 #include "lsnes.hpp"
 
 #include "core/advdumper.hpp"
+#include "core/botfarm.hpp"
 #include "core/controller.hpp"
 #include "core/command.hpp"
 #include "core/dispatch.hpp"
@@ -22,16 +23,33 @@
 #include "core/window.hpp"
 #include "library/directory.hpp"
 #include "library/crandom.hpp"
+#include "library/serialization.hpp"
 #include "library/string.hpp"
 
 #include <sys/time.h>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#define SEGMENTED_DUMPING
+#endif
 
 namespace
 {
 	bool hashing_in_progress = false;
 	uint64_t hashing_left = 0;
 	int64_t last_update = 0;
+	//Segmented dumping.
+	unsigned segment_count = 1;
+	unsigned segment_jobs = 0;
+	bool trailing_audio = false;
+	//Bot farm worker (no dumping, jobs from fd 3, results to fd 4).
+	bool worker_mode = false;
+	std::string program_name;
 
 	std::string do_download_movie(const std::string& origname)
 	{
@@ -81,6 +99,7 @@ namespace
 		}
 	}
 
+	//Frames and samples are routed to the dumper through this object, so the dump can be cut at exact point.
 	class myavsnoop : public dumper_base
 	{
 	public:
@@ -89,6 +108,8 @@ namespace
 		{
 			frames_dumped = 0;
 			total = frames_to_dump;
+			finished = false;
+			lsnes_instance.mdumper->drop_dumper(dumper);
 			lsnes_instance.mdumper->add_dumper(*this);
 		}
 
@@ -99,25 +120,48 @@ namespace
 
 		void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
 		{
+			if(finished)
+				return;
+			if(trailing_audio && frames_dumped >= total) {
+				//Audio up to this frame has been dumped. The frame itself belongs to the next segment.
+				finished = true;
+				CORE().command->invoke("quit-emulator");
+				return;
+			}
+			dumper.on_frame(_frame, fps_n, fps_d);
 			frames_dumped++;
 			if(frames_dumped % 100 == 0) {
 				std::cout << "Dumping frame " << frames_dumped << "/" << total << " ("
 					<< (100 * frames_dumped / total) << "%)" << std::endl;
 			}
-			if(frames_dumped >= total) {
+			if(frames_dumped >= total && !trailing_audio) {
 				//Rough way to end it.
 				CORE().command->invoke("quit-emulator");
 			}
 		}
 		void on_sample(short l, short r)
 		{
-			//We aren't interested in samples.
+			if(!finished && !dumper.kill_sample())
+				dumper.on_sample(l, r);
+		}
+		void on_samples(const int16_t* samples, size_t count, bool stereo)
+		{
+			if(finished)
+				return;
+			size_t killed = dumper.kill_samples(count);
+			if(killed < count)
+				dumper.on_samples(samples + (stereo ? 2 : 1) * killed, count - killed, stereo);
 		}
 		void on_rate_change(uint32_t n, uint32_t d)
 		{
-			//We aren't interested in samples.
+			dumper.on_rate_change(n, d);
 		}
 		void on_gameinfo_change(const master_dumper::gameinfo& gi)
+		{
+			print_gameinfo(gi);
+			dumper.on_gameinfo_change(gi);
+		}
+		void print_gameinfo(const master_dumper::gameinfo& gi)
 		{
 			std::cout << "Game:" << gi.gamename << std::endl;
 			std::cout << "Length:" << gi.get_readable_time(3) << std::endl;
@@ -127,12 +171,14 @@ namespace
 		}
 		void on_end()
 		{
+			dumper.on_end();
 			std::cout << "Finished!" << std::endl;
 			delete this;
 		}
 	private:
 		uint64_t frames_dumped;
 		uint64_t total;
+		bool finished;
 		dumper_base& dumper;
 	};
 
@@ -154,9 +200,413 @@ namespace
 			exit(1);
 		}
 		auto d = new myavsnoop(*_dumper, length);
-		d->on_gameinfo_change(lsnes_instance.mdumper->get_gameinfo());
+		d->print_gameinfo(lsnes_instance.mdumper->get_gameinfo());
 	}
 
+	bool is_segmentable(dumper_factory_base& dumper, const std::string& mode)
+	{
+		unsigned d = dumper.mode_details(mode) & dumper_factory_base::target_type_mask;
+		if(dumper.id() == "INTERNAL-JMD")
+			return d == dumper_factory_base::target_type_file;
+		if(dumper.id() == "INTERNAL-AVI" || dumper.id() == "INTERNAL-RAW")
+			return d == dumper_factory_base::target_type_prefix;
+		return false;
+	}
+
+	uint64_t copy_stream(std::istream& in, std::ostream& out)
+	{
+		char buffer[65536];
+		uint64_t copied = 0;
+		while(in) {
+			in.read(buffer, sizeof(buffer));
+			out.write(buffer, in.gcount());
+			copied += in.gcount();
+		}
+		if(!out)
+			throw std::runtime_error("Can't write merged output");
+		return copied;
+	}
+
+	void merge_concat(const std::vector<std::string>& inputs, const std::string& output)
+	{
+		std::ofstream out(output, std::ios::out | std::ios::binary);
+		for(auto& i : inputs) {
+			std::ifstream in(i, std::ios::in | std::ios::binary);
+			if(!in)
+				throw std::runtime_error("Can't open '" + i + "'");
+			copy_stream(in, out);
+		}
+	}
+
+	void merge_sox(const std::vector<std::string>& inputs, const std::string& output)
+	{
+		std::ofstream out(output, std::ios::out | std::ios::binary);
+		uint64_t bytes = 0;
+		for(size_t i = 0; i < inputs.size(); i++) {
+			std::ifstream in(inputs[i], std::ios::in | std::ios::binary);
+			char header[32];
+			in.read(header, sizeof(header));
+			if(in.gcount() < (std::streamsize)sizeof(header))
+				throw std::runtime_error("Can't read header of '" + inputs[i] + "'");
+			if(i == 0)
+				out.write(header, sizeof(header));
+			bytes += copy_stream(in, out);
+		}
+		//Fix up the sample count, each sample is 4 bytes.
+		char count[8];
+		serialization::u64l(count, bytes / 4);
+		out.seekp(8, std::ios::beg);
+		out.write(count, sizeof(count));
+		if(!out)
+			throw std::runtime_error("Can't fixup audio header");
+	}
+
+	struct jmd_packet
+	{
+		uint16_t channel;
+		uint64_t ts;
+		//The whole packet. The timestamp delta is filled in when written.
+		std::vector<char> data;
+	};
+
+	std::vector<char> read_jmd_header(std::istream& in)
+	{
+		std::vector<char> header(18);
+		in.read(&header[0], 18);
+		if(in.gcount() < 18)
+			throw std::runtime_error("JMD header truncated");
+		unsigned channels = serialization::u16b(&header[16]);
+		for(unsigned i = 0; i < channels; i++) {
+			size_t base = header.size();
+			header.resize(base + 6);
+			in.read(&header[base], 6);
+			if(in.gcount() < 6)
+				throw std::runtime_error("JMD header truncated");
+			size_t namelen = serialization::u16b(&header[base + 4]);
+			header.resize(base + 6 + namelen);
+			in.read(&header[base + 6], namelen);
+			if((size_t)in.gcount() < namelen)
+				throw std::runtime_error("JMD header truncated");
+		}
+		return header;
+	}
+
+	bool read_jmd_packet(std::istream& in, uint64_t& ts, jmd_packet& p)
+	{
+		p.data.resize(7);
+		in.read(&p.data[0], 7);
+		if(!in.gcount())
+			return false;
+		if(in.gcount() < 7)
+			throw std::runtime_error("JMD packet truncated");
+		p.channel = serialization::u16b(&p.data[0]);
+		ts += serialization::u32b(&p.data[2]);
+		p.ts = ts;
+		uint64_t len = 0;
+		int c;
+		do {
+			if((c = in.get()) < 0)
+				throw std::runtime_error("JMD packet truncated");
+			p.data.push_back(c);
+			len = (len << 7) | (c & 0x7F);
+		} while(c & 0x80);
+		size_t base = p.data.size();
+		p.data.resize(base + len);
+		in.read(&p.data[base], len);
+		if((uint64_t)in.gcount() < len)
+			throw std::runtime_error("JMD packet truncated");
+		return true;
+	}
+
+	void write_jmd_packet(std::ostream& out, uint64_t& last_ts, jmd_packet& p)
+	{
+		serialization::u32b(&p.data[2], p.ts - last_ts);
+		last_ts = p.ts;
+		out.write(&p.data[0], p.data.size());
+		if(!out)
+			throw std::runtime_error("Can't write merged JMD");
+	}
+
+	//Parallel segmented dumping. The main process runs through the movie without dumping, saving a state at
+	//each segment boundary and starting a worker process to dump the segment from that state. When all workers
+	//are done, the segments are merged.
+	class segment_runner
+	{
+	public:
+		struct segment
+		{
+			uint64_t first_frame;
+			uint64_t length;
+			//Timestamp of first frame in nanoseconds, as JMD timestamps video.
+			uint64_t video_ts;
+			std::string source;
+			std::string target;
+		};
+		segment_runner(const std::vector<std::string>& cmdline, const std::string& movie,
+			dumper_factory_base& _dumper, const std::string& mode, const std::string& _prefix,
+			uint64_t length)
+			: dumper(_dumper), prefix(_prefix)
+		{
+			for(auto i : cmdline) {
+				if(i.length() == 0 || i[0] != '-')
+					continue;	//Movie.
+				if(regex_match("--(length|overdump-length|prefix|segments|jobs)=.*", i))
+					continue;
+				if(i == "--trailing-audio")
+					continue;
+				base_args.push_back(i);
+			}
+			bool is_file = (dumper.mode_details(mode) & dumper_factory_base::target_type_mask) ==
+				dumper_factory_base::target_type_file;
+			segments.resize(segment_count);
+			for(unsigned i = 0; i < segment_count; i++) {
+				std::ostringstream x;
+				x << std::setw(4) << std::setfill('0') << i;
+				segments[i].first_frame = length * i / segment_count;
+				segments[i].length = length * (i + 1) / segment_count - segments[i].first_frame;
+				segments[i].video_ts = 0;
+				segments[i].source = i ? (prefix + ".seg" + x.str() + ".lsmv") : movie;
+				segments[i].target = prefix + (is_file ? ".seg" : "_seg") + x.str();
+			}
+			jobs = segment_jobs ? segment_jobs : segment_count;
+			failed = false;
+		}
+		size_t count() { return segments.size(); }
+		segment& operator[](size_t i) { return segments[i]; }
+		void start(unsigned i)
+		{
+			while(running.size() >= jobs)
+				reap(true);
+			std::vector<std::string> args = base_args;
+			args.push_back((stringfmt() << "--length=" << segments[i].length).str());
+			args.push_back("--prefix=" + segments[i].target);
+			if(i + 1 < segments.size())
+				args.push_back("--trailing-audio");
+			args.push_back(segments[i].source);
+			std::string logname = segments[i].target + ".log";
+			std::vector<char*> argv;
+			argv.push_back(const_cast<char*>(program_name.c_str()));
+			for(auto& j : args)
+				argv.push_back(const_cast<char*>(j.c_str()));
+			argv.push_back(NULL);
+			std::cout << "Starting segment " << i << " (frames " << segments[i].first_frame + 1 << "-"
+				<< segments[i].first_frame + segments[i].length << ", log in '" << logname << "')"
+				<< std::endl;
+#ifdef SEGMENTED_DUMPING
+			pid_t pid = fork();
+			if(pid < 0)
+				throw std::runtime_error("Can't start worker process");
+			if(pid == 0) {
+				int fd = open(logname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+				if(fd >= 0) {
+					dup2(fd, 1);
+					dup2(fd, 2);
+					close(fd);
+				}
+				execv("/proc/self/exe", &argv[0]);
+				execvp(argv[0], &argv[0]);
+				_exit(127);
+			}
+			running[pid] = i;
+#else
+			throw std::runtime_error("Segmented dumping is not supported on this platform");
+#endif
+		}
+		void finish()
+		{
+			while(!running.empty())
+				reap(true);
+			if(failed)
+				throw std::runtime_error("Dumping some segments failed, see the segment logs");
+			std::cout << "Merging segments..." << std::endl;
+			merge();
+			for(size_t i = 0; i < segments.size(); i++) {
+				if(i)
+					remove(segments[i].source.c_str());
+				remove((segments[i].target + ".log").c_str());
+			}
+			std::cout << "Segmented dump finished." << std::endl;
+		}
+	private:
+		void reap(bool block)
+		{
+#ifdef SEGMENTED_DUMPING
+			int status;
+			pid_t pid = waitpid(-1, &status, block ? 0 : WNOHANG);
+			if(pid <= 0 || !running.count(pid))
+				return;
+			unsigned i = running[pid];
+			running.erase(pid);
+			if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+				std::cout << "Segment " << i << " done." << std::endl;
+			} else {
+				std::cerr << "Segment " << i << " failed, see '" << segments[i].target << ".log'"
+					<< std::endl;
+				failed = true;
+			}
+#endif
+		}
+		void merge()
+		{
+			std::vector<std::string> parts;
+			if(dumper.id() == "INTERNAL-JMD") {
+				merge_jmd();
+				for(auto& i : segments)
+					remove(i.target.c_str());
+			} else if(dumper.id() == "INTERNAL-AVI") {
+				//Renumber the AVI files into one sequence, like the dumper itself splits them.
+				unsigned n = 0;
+				for(auto& i : segments) {
+					for(unsigned j = 0;; j++) {
+						std::string from = avi_name(i.target, j);
+						if(!directory::is_regular(from))
+							break;
+						if(directory::rename_overwrite(from.c_str(), avi_name(prefix, n++).c_str()))
+							throw std::runtime_error("Can't rename '" + from + "'");
+					}
+					parts.push_back(i.target + ".sox");
+				}
+				merge_sox(parts, prefix + ".sox");
+				for(auto& i : parts)
+					remove(i.c_str());
+			} else if(dumper.id() == "INTERNAL-RAW") {
+				const char* streams[] = {".video", ".audio"};
+				for(auto s : streams) {
+					parts.clear();
+					for(auto& i : segments)
+						parts.push_back(i.target + s);
+					merge_concat(parts, prefix + s);
+					for(auto& i : parts)
+						remove(i.c_str());
+				}
+			}
+		}
+		void merge_jmd()
+		{
+			std::ofstream out(prefix, std::ios::out | std::ios::binary);
+			std::vector<char> header;
+			//Packets past start of the next segment, waiting for the packets of next segment to catch up.
+			std::multimap<uint64_t, jmd_packet> carry;
+			uint64_t last_ts = 0;
+			for(size_t i = 0; i < segments.size(); i++) {
+				std::ifstream in(segments[i].target, std::ios::in | std::ios::binary);
+				if(!in)
+					throw std::runtime_error("Can't open '" + segments[i].target + "'");
+				std::vector<char> h = read_jmd_header(in);
+				if(i == 0) {
+					header = h;
+					out.write(&header[0], header.size());
+				} else if(h != header)
+					throw std::runtime_error("JMD segments have different headers");
+				bool last = (i + 1 == segments.size());
+				uint64_t limit = last ? 0xFFFFFFFFFFFFFFFFULL : segments[i + 1].video_ts;
+				uint64_t ts = 0;
+				jmd_packet p;
+				while(read_jmd_packet(in, ts, p)) {
+					if(p.channel == 3 && !last)
+						continue;	//End of segment marker.
+					p.ts += segments[i].video_ts;
+					while(!carry.empty() && carry.begin()->first <= p.ts) {
+						write_jmd_packet(out, last_ts, carry.begin()->second);
+						carry.erase(carry.begin());
+					}
+					if(p.ts > limit)
+						carry.insert(std::make_pair(p.ts, p));
+					else
+						write_jmd_packet(out, last_ts, p);
+				}
+			}
+			for(auto& i : carry)
+				write_jmd_packet(out, last_ts, i.second);
+		}
+		static std::string avi_name(const std::string& prefix, unsigned n)
+		{
+			std::ostringstream x;
+			x << prefix << "_" << std::setw(5) << std::setfill('0') << n << ".avi";
+			return x.str();
+		}
+		dumper_factory_base& dumper;
+		std::string prefix;
+		std::vector<std::string> base_args;
+		std::vector<segment> segments;
+		std::map<int, unsigned> running;
+		unsigned jobs;
+		bool failed;
+	};
+
+	//Runs the pre-pass of segmented dump.
+	class segment_planner : public dumper_base
+	{
+	public:
+		segment_planner(segment_runner& _runner)
+			: runner(_runner)
+		{
+			frames = 0;
+			video_w = 0;
+			video_n = 0;
+			next = 1;
+			pending = false;
+			lsnes_instance.mdumper->add_dumper(*this);
+		}
+		~segment_planner() throw()
+		{
+			lsnes_instance.mdumper->drop_dumper(*this);
+		}
+		void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
+		{
+			frames++;
+			video_w += (1000000000ULL * fps_d) / fps_n;
+			video_n += (1000000000ULL * fps_d) % fps_n;
+			if(video_n >= fps_n) {
+				video_n -= fps_n;
+				video_w++;
+			}
+			if(next >= runner.count())
+				return;
+			if(pending) {
+				//The state was saved at start of this frame.
+				wait_pending_saves();
+				runner.start(next++);
+				pending = false;
+				if(next == runner.count()) {
+					CORE().command->invoke("quit-emulator");
+					return;
+				}
+			}
+			if(frames == runner[next].first_frame) {
+				runner[next].video_ts = video_w;
+				CORE().command->invoke("save-state " + runner[next].source);
+				pending = true;
+			}
+			if(frames % 1000 == 0)
+				std::cout << "Pre-pass at frame " << frames << "/" << runner[runner.count() - 1].first_frame
+					<< std::endl;
+		}
+		void on_sample(short l, short r)
+		{
+		}
+		void on_samples(const int16_t* samples, size_t count, bool stereo)
+		{
+		}
+		void on_rate_change(uint32_t n, uint32_t d)
+		{
+		}
+		void on_gameinfo_change(const master_dumper::gameinfo& gi)
+		{
+		}
+		void on_end()
+		{
+			delete this;
+		}
+	private:
+		segment_runner& runner;
+		uint64_t frames;
+		uint64_t video_w;
+		uint64_t video_n;
+		size_t next;
+		bool pending;
+	};
+
 	void startup_lua_scripts(const std::vector<std::string>& cmdline)
 	{
 		for(auto i = cmdline.begin(); i != cmdline.end(); i++) {
@@ -195,7 +645,7 @@ namespace
 		return r;
 	}
 
-	dumper_factory_base& get_dumper(const std::vector<std::string>& cmdline, std::string& mode,
+	dumper_factory_base* get_dumper(const std::vector<std::string>& cmdline, std::string& mode,
 		std::string& prefix, uint64_t& length, bool& overdump_mode, uint64_t& overdump_length)
 	{
 		bool dumper_given = false;
@@ -238,6 +688,28 @@ namespace
 					std::cerr << "Bad --overdump-length: " << e.what() << std::endl;
 					exit(1);
 				}
+			else if(a.length() >= 11 && a.substr(0, 11) == "--segments=")
+				try {
+					segment_count = raw_lexical_cast<unsigned>(a.substr(11));
+					if(!segment_count)
+						throw std::runtime_error("Segment count out of range (1-)");
+				} catch(std::exception& e) {
+					std::cerr << "Bad --segments: " << e.what() << std::endl;
+					exit(1);
+				}
+			else if(a.length() >= 7 && a.substr(0, 7) == "--jobs=")
+				try {
+					segment_jobs = raw_lexical_cast<unsigned>(a.substr(7));
+					if(!segment_jobs)
+						throw std::runtime_error("Job count out of range (1-)");
+				} catch(std::exception& e) {
+					std::cerr << "Bad --jobs: " << e.what() << std::endl;
+					exit(1);
+				}
+			else if(a == "--trailing-audio")
+				trailing_audio = true;
+			else if(a == "--worker")
+				worker_mode = true;
 			else if(a.length() >= 9 && a.substr(0, 9) == "--option=") {
 				std::string nameval = a.substr(9);
 				size_t s = nameval.find_first_of("=");
@@ -263,6 +735,8 @@ namespace
 					exit(1);
 				}
 		}
+		if(worker_mode)
+			return NULL;
 		if(dumper == "list") {
 			//Help on dumpers.
 			std::set<dumper_factory_base*> dumpers = dumper_factory_base::get_dumper_set();
@@ -311,7 +785,11 @@ namespace
 				<< std::endl;
 			exit(1);
 		}
-		return locate_dumper(dumper);
+		if(segment_count > 1 && !is_segmentable(_dumper, mode)) {
+			std::cerr << "Segmented dumping is not supported for this dumper and mode" << std::endl;
+			exit(1);
+		}
+		return &locate_dumper(dumper);
 	}
 }
 
@@ -325,6 +803,7 @@ int main(int argc, char** argv)
 	}
 
 	reached_main();
+	program_name = argv[0];
 	std::vector<std::string> cmdline;
 	for(int i = 1; i < argc; i++)
 		cmdline.push_back(argv[i]);
@@ -332,7 +811,7 @@ int main(int argc, char** argv)
 	bool overdump_mode;
 	std::string mode, prefix;
 
-	dumper_factory_base& dumper = get_dumper(cmdline, mode, prefix, length, overdump_mode, overdump_length);
+	dumper_factory_base* dumper = get_dumper(cmdline, mode, prefix, length, overdump_mode, overdump_length);
 
 	set_random_seed();
 	platform::init();
@@ -383,6 +862,7 @@ int main(int argc, char** argv)
 		return 0;
 	}
 
+	std::string origmovfn = movfn;
 	try {
 		movfn = do_download_movie(movfn);
 	} catch(std::exception& e) {
@@ -421,11 +901,26 @@ int main(int argc, char** argv)
 		messages << "Using core: " << lsnes_instance.rom->get_core_identifier() << std::endl;
 		lsnes_instance.rom->set_internal_region(movie->gametype->get_region());
 		lsnes_instance.rom->load(movie->settings, movie->movie_rtc_second, movie->movie_rtc_subsecond);
+		if(worker_mode)
+			botfarm_worker_init(3, 4);
 		startup_lua_scripts(cmdline);
 		if(overdump_mode)
 			length = overdump_length + movie->get_frame_count();
-		dumper_startup(dumper, mode, prefix, length);
-		main_loop(r, *movie, true);
+		if(worker_mode) {
+			//The worker script drives the emulation and ends it when the coordinator goes away.
+			main_loop(r, *movie, true);
+		} else if(segment_count > 1) {
+			if(length < segment_count)
+				throw std::runtime_error("Too many segments for dump length");
+			segment_runner runner(cmdline, origmovfn, *dumper, mode, prefix, length);
+			new segment_planner(runner);
+			runner.start(0);
+			main_loop(r, *movie, true);
+			runner.finish();
+		} else {
+			dumper_startup(*dumper, mode, prefix, length);
+			main_loop(r, *movie, true);
+		}
 	} catch(std::bad_alloc& e) {
 		OOM_panic();
 	} catch(std::exception& e) {
@@ -4,7 +4,9 @@
 #include "video/avi/codec.hpp"
 
 #include "core/advdumper.hpp"
+#include "core/command.hpp"
 #include "core/dispatch.hpp"
+#include "core/framerate.hpp"
 #include "lua/lua.hpp"
 #include "library/minmax.hpp"
 #include "library/workthread.hpp"
@@ -97,6 +99,8 @@ namespace
 		"AVI‣Right padding", 0);
 	settingvar::supervariable<settingvar::model_int<0, 999999999>> max_frames_per_segment(lsnes_setgrp,
 		"avi-maxframes", "AVI‣Max frames per segment", 0);
+	settingvar::supervariable<settingvar::model_int<2, 64>> queue_depth(lsnes_setgrp, "avi-queue-depth",
+		"AVI‣Frame queue depth", 4);
 #ifdef WITH_SECRET_RABBIT_CODE
 	settingvar::enumeration soundrates {"nearest-common", "round-down", "round-up", "multiply",
 		"High quality 44.1kHz", "High quality 48kHz"};
@@ -131,8 +135,133 @@ namespace
 		uint32_t sample_rate;
 		uint16_t audio_chans;
 		uint32_t max_frames;
+		uint32_t queue_depth;
 	};
 
+	//Preallocated frame buffers handed from the emulator thread to the AVI worker. Getting a buffer waits only if
+	//depth frames are waiting for the encoder. Frames waiting for sound samples (parked) don't count, as those
+	//can only be written after the emulation proceeds.
+	struct frame_pool
+	{
+		frame_pool(size_t _depth);
+		~frame_pool();
+		void get(frame_object& f, size_t words);
+		void put(frame_object& f);
+		void set_parked(size_t count);
+		void abort();
+		std::string status();
+	private:
+		struct buffer
+		{
+			uint32_t* odata;
+			size_t size;
+			bool free;
+		};
+		threads::lock mlock;
+		threads::cv cond;
+		std::vector<buffer> buffers;
+		size_t depth;
+		size_t inuse;
+		size_t max_inuse;
+		size_t parked;
+		bool aborted;
+		uint64_t stalls;
+		uint64_t stall_time;
+	};
+
+	frame_pool::frame_pool(size_t _depth)
+	{
+		depth = _depth;
+		inuse = 0;
+		max_inuse = 0;
+		parked = 0;
+		aborted = false;
+		stalls = 0;
+		stall_time = 0;
+	}
+
+	frame_pool::~frame_pool()
+	{
+		for(auto& i : buffers)
+			delete[] i.odata;
+	}
+
+	void frame_pool::get(frame_object& f, size_t words)
+	{
+		threads::alock h(mlock);
+		if(inuse >= depth + parked && !aborted) {
+			uint64_t t = framerate_regulator::get_utime();
+			while(inuse >= depth + parked && !aborted)
+				cond.wait(h);
+			stalls++;
+			stall_time += framerate_regulator::get_utime() - t;
+		}
+		if(aborted)
+			throw std::runtime_error("AVI worker has failed");
+		buffer* b = NULL;
+		for(auto& i : buffers)
+			if(i.free) {
+				b = &i;
+				break;
+			}
+		if(!b) {
+			buffer n;
+			n.odata = NULL;
+			n.size = 0;
+			n.free = true;
+			buffers.push_back(n);
+			b = &buffers.back();
+		}
+		if(b->size < words) {
+			//Leave space for aligning the data.
+			uint32_t* n = new uint32_t[words + 8];
+			delete[] b->odata;
+			b->odata = n;
+			b->size = words;
+		}
+		b->free = false;
+		inuse++;
+		max_inuse = max(max_inuse, inuse);
+		f.odata = b->odata;
+		f.data = f.odata;
+		while(reinterpret_cast<size_t>(f.data) % 32)
+			f.data++;
+	}
+
+	void frame_pool::put(frame_object& f)
+	{
+		threads::alock h(mlock);
+		for(auto& i : buffers)
+			if(i.odata == f.odata && !i.free) {
+				i.free = true;
+				inuse--;
+			}
+		cond.notify_all();
+	}
+
+	void frame_pool::set_parked(size_t count)
+	{
+		threads::alock h(mlock);
+		parked = count;
+		cond.notify_all();
+	}
+
+	void frame_pool::abort()
+	{
+		threads::alock h(mlock);
+		aborted = true;
+		cond.notify_all();
+	}
+
+	std::string frame_pool::status()
+	{
+		threads::alock h(mlock);
+		std::ostringstream x;
+		x << "Frame queue: " << inuse << " frame(s) queued (peak " << max_inuse << ", depth " << depth
+			<< "), emulation stalled " << stalls << " time(s) for " << stall_time / 1000 << " ms";
+		return x.str();
+	}
+
 	struct avi_worker;
 
 	struct resample_worker : public workthread
@@ -160,17 +289,18 @@ namespace
 		avi_worker(const struct avi_info& info);
 		~avi_worker();
 		void entry();
-		void queue_video(uint32_t* _frame, uint32_t stride, uint32_t width, uint32_t height, uint32_t fps_n,
-			uint32_t fps_d);
+		void queue_video(const uint32_t* _frame, uint32_t stride, uint32_t width, uint32_t height,
+			uint32_t fps_n, uint32_t fps_d);
 		void queue_audio(int16_t* data, size_t samples);
+		std::string queue_status();
 	private:
+		void run();
+		//The pool has to outlive the writer, which returns the frames to it.
+		frame_pool pool;
 		avi_writer aviout;
-		uint32_t* frame;
-		uint32_t frame_width;
-		uint32_t frame_stride;
-		uint32_t frame_height;
-		uint32_t frame_fps_n;
-		uint32_t frame_fps_d;
+		//Frames queued by emulator thread, but not yet taken by the worker.
+		threads::lock pending_lock;
+		std::deque<frame_object> pending;
 		uint32_t segframes;
 		uint32_t max_segframes;
 		bool closed;
@@ -182,8 +312,10 @@ namespace
 #define WORKFLAG_END 4
 
 	avi_worker::avi_worker(const struct avi_info& info)
-		: aviout(info.prefix, *info.vcodec, *info.acodec, info.sample_rate, info.audio_chans)
+		: pool(info.queue_depth), aviout(info.prefix, *info.vcodec, *info.acodec, info.sample_rate,
+		info.audio_chans)
 	{
+		aviout.set_frame_release([this](frame_object& f) -> void { this->pool.put(f); });
 		ivcodec = info.vcodec;
 		segframes = 0;
 		max_segframes = info.max_frames;
@@ -195,18 +327,27 @@ namespace
 	{
 	}
 
-	void avi_worker::queue_video(uint32_t* _frame, uint32_t stride, uint32_t width, uint32_t height,
+	void avi_worker::queue_video(const uint32_t* _frame, uint32_t stride, uint32_t width, uint32_t height,
 		uint32_t fps_n, uint32_t fps_d)
 	{
 		rethrow();
-		wait_busy();
-		frame = _frame;
-		frame_width = width;
-		frame_stride = stride;
-		frame_height = height;
-		frame_fps_n = fps_n;
-		frame_fps_d = fps_d;
-		set_busy();
+		frame_object f;
+		pool.get(f, static_cast<size_t>(stride) * height);
+		f.stride = stride;
+		f.width = width;
+		f.height = height;
+		f.fps_n = fps_n;
+		f.fps_d = fps_d;
+		f.force_break = false;
+		framebuffer::copy_swap4(reinterpret_cast<uint8_t*>(f.data), _frame, static_cast<size_t>(stride) *
+			height);
+		try {
+			threads::alock h(pending_lock);
+			pending.push_back(f);
+		} catch(...) {
+			pool.put(f);
+			throw;
+		}
 		set_workflag(WORKFLAG_QUEUE_FRAME);
 	}
 
@@ -217,41 +358,51 @@ namespace
 		set_workflag(WORKFLAG_FLUSH);
 	}
 
+	std::string avi_worker::queue_status()
+	{
+		return pool.status();
+	}
+
 	void avi_worker::entry()
+	{
+		try {
+			run();
+		} catch(...) {
+			//Don't leave the emulator thread waiting for frame buffers.
+			pool.abort();
+			throw;
+		}
+	}
+
+	void avi_worker::run()
 	{
 		while(1) {
 			wait_workflag();
 			uint32_t work = clear_workflag(~workthread::quit_request);
-			//Flush the queue first in order to provode backpressure.
-			if(work & WORKFLAG_FLUSH) {
-				clear_workflag(WORKFLAG_FLUSH);
-				aviout.flush();
-			}
-			//Then add frames if any.
+			//Hand the queued frames to the writer.
 			if(work & WORKFLAG_QUEUE_FRAME) {
-				frame_object f;
-				f.stride = frame_stride;
-				f.odata = new uint32_t[f.stride * frame_height + 16];
-				f.data = f.odata;
-				while(reinterpret_cast<size_t>(f.data) % 16)
-					f.data++;
-				f.width = frame_width;
-				f.height = frame_height;
-				f.fps_n = frame_fps_n;
-				f.fps_d = frame_fps_d;
-				f.force_break = (segframes == max_segframes && max_segframes > 0);
-				if(f.force_break)
-					segframes = 0;
+				clear_workflag(WORKFLAG_QUEUE_FRAME);
+				std::deque<frame_object> frames;
+				{
+					threads::alock h(pending_lock);
+					std::swap(frames, pending);
+				}
+				for(auto& f : frames) {
+					f.force_break = (segframes == max_segframes && max_segframes > 0);
+					if(f.force_break)
+						segframes = 0;
+					aviout.video_queue().push_back(f);
+					segframes++;
+				}
 				auto wc = get_wait_count();
 				ivcodec->send_performance_counters(wc.first, wc.second);
-				framebuffer::copy_swap4(reinterpret_cast<uint8_t*>(f.data), frame,
-					f.stride * frame_height);
-				frame = NULL;
-				clear_workflag(WORKFLAG_QUEUE_FRAME);
-				clear_busy();
-				aviout.video_queue().push_back(f);
-				segframes++;
-				set_workflag(WORKFLAG_FLUSH);
+				work |= WORKFLAG_FLUSH;
+			}
+			//Then encode whatever has sound samples available.
+			if(work & WORKFLAG_FLUSH) {
+				clear_workflag(WORKFLAG_FLUSH);
+				aviout.flush();
+				pool.set_parked(aviout.video_queue().size());
 			}
 			//End the streaam if that is flagged.
 			if(work & WORKFLAG_END) {
@@ -353,6 +504,7 @@ again:
 			info.audio_chans = 2;
 			info.sample_rate = 32000;
 			info.max_frames = max_frames_per_segment(*core.settings);
+			info.queue_depth = queue_depth(*core.settings);
 			info.prefix = prefix;
 			rpair(vcodec, acodec) = find_codecs(mode);
 			info.vcodec = vcodec->get_instance();
@@ -396,6 +548,8 @@ again:
 			mdumper.drop_dumper(*this);
 			if(resampler_w)
 				delete resampler_w;
+			if(worker)
+				messages << worker->queue_status() << std::endl;
 			delete worker;
 			delete soxdumper;
 			messages << "AVI Dump finished" << std::endl;
@@ -413,40 +567,57 @@ again:
 				rpair(hscl, vscl) = core.rom->get_scale_factors(_frame.get_width(),
 					_frame.get_height());
 			}
-			if(!render_video_hud(dscr, _frame, fps_n, fps_d, hscl, vscl, dlb(*core.settings),
-				dtb(*core.settings), drb(*core.settings), dbb(*core.settings),
-				[this]() -> void { this->worker->wait_busy(); }))
+			auto f = render_video_hud_shared(dscr, _frame, fps_n, fps_d, hscl, vscl, dlb(*core.settings),
+				dtb(*core.settings), drb(*core.settings), dbb(*core.settings), NULL);
+			if(!f)
 				return;
-			worker->queue_video(dscr.rowptr(0), dscr.get_stride(), dscr.get_width(), dscr.get_height(),
-				fps_n, fps_d);
+			worker->queue_video(f->rowptr(0), f->get_stride(), f->get_width(), f->get_height(), fps_n,
+				fps_d);
 			have_dumped_frame = true;
 		}
 		void on_sample(short l, short r)
+		{
+			int16_t x[2];
+			x[0] = l;
+			x[1] = r;
+			on_samples(x, 1, true);
+		}
+		void on_samples(const int16_t* samples, size_t count, bool stereo)
 		{
 			if(resampler_w) {
 				if(!have_dumped_frame)
 					return;
-				sbuffer[sbuffer_fill++] = l;
-				sbuffer[sbuffer_fill++] = r;
-				if(sbuffer_fill == sbuffer.size()) {
-					resampler_w->sendblock(&sbuffer[0], sbuffer_fill / chans);
-					sbuffer_fill = 0;
+				for(size_t i = 0; i < count; i++) {
+					sbuffer[sbuffer_fill++] = stereo ? samples[2 * i + 0] : samples[i];
+					sbuffer[sbuffer_fill++] = stereo ? samples[2 * i + 1] : samples[i];
+					if(sbuffer_fill == sbuffer.size()) {
+						resampler_w->sendblock(&sbuffer[0], sbuffer_fill / chans);
+						sbuffer_fill = 0;
+					}
 				}
-				soxdumper->sample(l, r);
+				soxdumper->samples(samples, count, stereo);
 				return;
 			}
-			short x[2];
-			x[0] = l;
-			x[1] = r;
-			dcounter += soundrate.first;
-			while(dcounter < soundrate.second * audio_record_rate + soundrate.first) {
-				if(have_dumped_frame)
-					worker->queue_audio(x, 2);
+			//Collect the whole block so it can be queued at once.
+			abuffer.clear();
+			for(size_t i = 0; i < count; i++) {
+				int16_t l = stereo ? samples[2 * i + 0] : samples[i];
+				int16_t r = stereo ? samples[2 * i + 1] : samples[i];
 				dcounter += soundrate.first;
+				while(dcounter < soundrate.second * audio_record_rate + soundrate.first) {
+					if(have_dumped_frame) {
+						abuffer.push_back(l);
+						abuffer.push_back(r);
+					}
+					dcounter += soundrate.first;
+				}
+				dcounter -= (soundrate.second * audio_record_rate + soundrate.first);
+			}
+			if(have_dumped_frame) {
+				if(!abuffer.empty())
+					worker->queue_audio(&abuffer[0], abuffer.size());
+				soxdumper->samples(samples, count, stereo);
 			}
-			dcounter -= (soundrate.second * audio_record_rate + soundrate.first);
-			if(have_dumped_frame)
-				soxdumper->sample(l, r);
 		}
 		void on_rate_change(uint32_t n, uint32_t d)
 		{
@@ -478,6 +649,7 @@ again:
 		uint32_t audio_record_rate;
 		std::vector<short> sbuffer;
 		size_t sbuffer_fill;
+		std::vector<int16_t> abuffer;
 		uint32_t chans;
 	};
 
@@ -527,6 +699,17 @@ again:
 	{
 	}
 
+	command::fnptr<> CMD_avi_status(lsnes_cmds, "avi-status", "Show AVI dump status",
+		"Syntax: avi-status\nShow frame queue statistics of AVI dump in progress.\n",
+		[]() {
+			auto d = dynamic_cast<avi_dumper_obj*>(CORE().mdumper->get_instance(&adv));
+			if(!d || !d->worker) {
+				messages << "No AVI dump in progress" << std::endl;
+				return;
+			}
+			messages << d->worker->queue_status() << std::endl;
+		});
+
 	void resample_worker::entry()
 	{
 		while(1) {
@@ -210,8 +210,7 @@ uint64_t avi_output_stream::get_size_estimate()
 	return avifile.movi.payload_size;
 }
 
-bool avi_output_stream::readqueue(uint32_t* _frame, uint32_t* oframe, uint32_t stride, sample_queue& aqueue,
-	bool force)
+bool avi_output_stream::readqueue(uint32_t* _frame, uint32_t stride, sample_queue& aqueue, bool force)
 {
 	if(!in_segment)
 		throw std::runtime_error("Trying to write to non-open AVI");
@@ -224,7 +223,6 @@ bool avi_output_stream::readqueue(uint32_t* _frame, uint32_t* oframe, uint32_t s
 	frame(_frame, stride);
 	video_timer.increment();
 	samples(&tmp[0], fsamples);
-	delete[] oframe;
 	return true;
 }
 
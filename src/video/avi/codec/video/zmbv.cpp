@@ -1,6 +1,10 @@
 #include "video/avi/codec.hpp"
 #include "core/instance.hpp"
 #include "core/settings.hpp"
+#include "library/arch-detect.hpp"
+#include "library/cpu-features.hpp"
+#include "library/minmax.hpp"
+#include "library/workthread.hpp"
 #include "library/zlibstream.hpp"
 #include <zlib.h>
 #include <limits>
@@ -23,6 +27,129 @@ namespace
 		"AVI‣ZMBV‣Block height", 16);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> fsrch(lsnes_setgrp,
 		"avi-zmbv-fullsearch", "AVI‣ZMBV‣Full search (slow)", false);
+	settingvar::supervariable<settingvar::model_int<0,64>> mvthreads(lsnes_setgrp, "avi-zmbv-threads",
+		"AVI‣ZMBV‣Motion search threads (0 = auto)", 0);
+
+	//Count nonzero bytes in XOR of blocks. Stops early (returning something over limit) once count exceeds
+	//limit.
+	uint32_t xor_nonzero_generic(const uint32_t* src1, const uint32_t* src2, size_t stride, uint32_t bw,
+		uint32_t bh, uint32_t limit)
+	{
+		uint32_t e = 0;
+		for(uint32_t y = 0; y < bh; y++) {
+			uint32_t x = 0;
+			for(; x + 2 <= bw; x += 2) {
+				uint64_t a, b;
+				memcpy(&a, src1 + x, 8);
+				memcpy(&b, src2 + x, 8);
+				//Collapse each byte to its low bit, then sum the bytes.
+				uint64_t t = a ^ b;
+				t |= t >> 4;
+				t |= t >> 2;
+				t |= t >> 1;
+				t &= 0x0101010101010101ULL;
+				e += (t * 0x0101010101010101ULL) >> 56;
+			}
+			for(; x < bw; x++) {
+				uint32_t t = src1[x] ^ src2[x];
+				e += ((t & 0xFF) ? 1 : 0) + ((t & 0xFF00) ? 1 : 0) + ((t & 0xFF0000) ? 1 : 0) +
+					((t & 0xFF000000U) ? 1 : 0);
+			}
+			if(e > limit)
+				return e;
+			src1 += stride;
+			src2 += stride;
+		}
+		return e;
+	}
+}
+
+#ifdef ARCH_HAS_I386_INTRINSICS
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include <emmintrin.h>
+namespace
+{
+	uint32_t xor_nonzero_sse2(const uint32_t* src1, const uint32_t* src2, size_t stride, uint32_t bw,
+		uint32_t bh, uint32_t limit)
+	{
+		//Blocks are at most 64 pixels wide, so the per-byte zero counters can't overflow within a row.
+		const __m128i zero = _mm_setzero_si128();
+		uint32_t e = 0;
+		uint32_t vbw = bw & ~3U;
+		for(uint32_t y = 0; y < bh; y++) {
+			__m128i zeroes = zero;
+			for(uint32_t x = 0; x < vbw; x += 4) {
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src2 + x));
+				zeroes = _mm_sub_epi8(zeroes, _mm_cmpeq_epi8(_mm_xor_si128(a, b), zero));
+			}
+			zeroes = _mm_sad_epu8(zeroes, zero);
+			e += 4 * vbw - _mm_cvtsi128_si32(zeroes) - _mm_cvtsi128_si32(_mm_srli_si128(zeroes, 8));
+			if(vbw < bw)
+				e += xor_nonzero_generic(src1 + vbw, src2 + vbw, stride, bw - vbw, 1, limit);
+			if(e > limit)
+				return e;
+			src1 += stride;
+			src2 += stride;
+		}
+		return e;
+	}
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+namespace
+{
+	uint32_t xor_nonzero_avx2(const uint32_t* src1, const uint32_t* src2, size_t stride, uint32_t bw,
+		uint32_t bh, uint32_t limit)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		uint32_t e = 0;
+		uint32_t vbw = bw & ~7U;
+		for(uint32_t y = 0; y < bh; y++) {
+			__m256i zeroes = zero;
+			for(uint32_t x = 0; x < vbw; x += 8) {
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src1 + x));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src2 + x));
+				zeroes = _mm256_sub_epi8(zeroes, _mm256_cmpeq_epi8(_mm256_xor_si256(a, b), zero));
+			}
+			zeroes = _mm256_sad_epu8(zeroes, zero);
+			__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(zeroes), _mm256_extracti128_si256(zeroes,
+				1));
+			e += 4 * vbw - _mm_cvtsi128_si32(sum) - _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+			if(vbw < bw)
+				e += xor_nonzero_generic(src1 + vbw, src2 + vbw, stride, bw - vbw, 1, limit);
+			if(e > limit)
+				return e;
+			src1 += stride;
+			src2 += stride;
+		}
+		return e;
+	}
+}
+#pragma GCC pop_options
+#endif
+
+namespace
+{
+	typedef uint32_t (*xor_nonzero_fn)(const uint32_t* src1, const uint32_t* src2, size_t stride, uint32_t bw,
+		uint32_t bh, uint32_t limit);
+
+	xor_nonzero_fn select_xor_nonzero()
+	{
+#ifdef ARCH_HAS_I386_INTRINSICS
+		if(cpu_features::avx2())
+			return xor_nonzero_avx2;
+		if(cpu_features::sse2())
+			return xor_nonzero_sse2;
+#endif
+		return xor_nonzero_generic;
+	}
+
+	struct zmbv_mv_worker;
 
 	//Motion vector.
 	struct motion
@@ -38,7 +165,8 @@ namespace
 	//The main ZMBV decoder state.
 	struct avi_codec_zmbv : public avi_video_codec
 	{
-		avi_codec_zmbv(uint32_t _level, uint32_t maxpframes, uint32_t _bw, uint32_t _bh, bool _fullsearch);
+		avi_codec_zmbv(uint32_t _level, uint32_t maxpframes, uint32_t _bw, uint32_t _bh, bool _fullsearch,
+			uint32_t _threads);
 		~avi_codec_zmbv();
 		avi_video_codec::format reset(uint32_t width, uint32_t height, uint32_t fps_n, uint32_t fps_d);
 		void frame(uint32_t* data, uint32_t stride);
@@ -66,30 +194,84 @@ namespace
 		bool fullsearch;
 		//Motion vector buffer, one motion vector for each block, in left-to-right, top-to-bottom order.
 		std::vector<motion> mv;
-		//Pixel buffer (2 full frames and one block).
+		//Pixel buffer (2 full frames).
 		std::vector<uint32_t> pixbuf;
 		//Current frame pointer.
 		uint32_t* current_frame;
 		//Previous frame pointer.
 		uint32_t* prev_frame;
-		//Scratch block pointer.
-		uint32_t* scratch;
+		//Penalty kernel.
+		xor_nonzero_fn xor_nonzero;
+		//Motion search helper threads. Each handles every (n+1)th block row, the calling thread does the rest.
+		std::vector<zmbv_mv_worker*> workers;
 		//Output buffer. Sufficient space to hold uncompressed data.
 		std::vector<char> outbuffer;
 		//Output scratch memory.
 		char* oscratch;
 		//Zlib streaam.
 		zlibstream z;
-		//Compute penalty for motion vector (dx, dy) on block with upper-left corner at (bx, by).
-		uint32_t mv_penalty(uint32_t bx, uint32_t by, int dx, int dy);
+		//Compute penalty for motion vector (dx, dy) on block with upper-left corner at (bx, by). Penalties
+		//over limit are not exact.
+		uint32_t mv_penalty(uint32_t bx, uint32_t by, int dx, int dy, uint32_t limit);
 		//Do motion detection for block with upper-left corner at (bx, by). M is filled with the resulting
 		//motion vector and t is initial guess for the motion vector.
 		void mv_detect(uint32_t bx, uint32_t by, motion& m, motion t);
+		//Do motion detection for every step'th block row starting from first.
+		void mv_detect_rows(uint32_t first, uint32_t step);
+		friend struct zmbv_mv_worker;
 		//Serialize movement vectors and furrent frame data to output buffer. If keyframe is true, keyframe is
 		//written, otherwise non-keyframe.
 		void serialize_frame(bool keyframe);
 	};
 
+	//Motion search helper thread.
+	struct zmbv_mv_worker : public workthread
+	{
+		zmbv_mv_worker(avi_codec_zmbv& _codec, uint32_t _first, uint32_t _step);
+		~zmbv_mv_worker();
+		void entry();
+		void start();
+	private:
+		avi_codec_zmbv& codec;
+		uint32_t first;
+		uint32_t step;
+	};
+
+#define WORKFLAG_DETECT 1
+
+	zmbv_mv_worker::zmbv_mv_worker(avi_codec_zmbv& _codec, uint32_t _first, uint32_t _step)
+		: codec(_codec)
+	{
+		first = _first;
+		step = _step;
+		fire();
+	}
+
+	zmbv_mv_worker::~zmbv_mv_worker()
+	{
+	}
+
+	void zmbv_mv_worker::start()
+	{
+		set_busy();
+		set_workflag(WORKFLAG_DETECT);
+	}
+
+	void zmbv_mv_worker::entry()
+	{
+		while(1) {
+			wait_workflag();
+			uint32_t work = clear_workflag(~workthread::quit_request);
+			if(work & WORKFLAG_DETECT) {
+				codec.mv_detect_rows(first, step);
+				clear_workflag(WORKFLAG_DETECT);
+				clear_busy();
+			}
+			if(work == workthread::quit_request)
+				break;
+		}
+	}
+
 	//Compute XOR of blocks.
 	void xor_blocks(uint32_t* target, uint32_t* src1, uint32_t src1x, uint32_t src1y,
 		uint32_t src1w, uint32_t src1h, uint32_t* src2, uint32_t src2x, uint32_t src2y,
@@ -106,25 +288,13 @@ namespace
 		}
 	}
 
-	//Estimate entropy.
-	uint32_t entropy(uint32_t* data, uint32_t bw, uint32_t bh)
-	{
-		//Because XORs are essentially random, calculate the number of non-zeroes to ascertain badness.
-		uint8_t* _data = reinterpret_cast<uint8_t*>(data);
-		uint32_t e = 0;
-		size_t imax = 4 * bw * bh;
-		for(size_t i = 0; i < imax; i++)
-			if(_data[i])
-				e++;
-		return e;
-	}
-
-	uint32_t avi_codec_zmbv::mv_penalty(uint32_t bx, uint32_t by, int dx, int dy)
+	uint32_t avi_codec_zmbv::mv_penalty(uint32_t bx, uint32_t by, int dx, int dy, uint32_t limit)
 	{
-		//Penalty is entropy estimate of resulting block.
-		xor_blocks(scratch, current_frame, bx, by, ewidth + 2 * MAXIMUM_VECTOR, eheight, prev_frame, bx + dx,
-			by + dy, ewidth + 2 * MAXIMUM_VECTOR, eheight, bw, bh);
-		return entropy(scratch, bw, bh);
+		//Penalty is entropy estimate of resulting block. Because XORs are essentially random, calculate the
+		//number of non-zeroes to ascertain badness.
+		size_t stride = ewidth + 2 * MAXIMUM_VECTOR;
+		return xor_nonzero(current_frame + by * stride + bx, prev_frame + (by + dy) * stride + (bx + dx),
+			stride, bw, bh, limit);
 	}
 
 	void avi_codec_zmbv::serialize_frame(bool keyframe)
@@ -198,27 +368,27 @@ compress:
 	{
 		//Try the suggested vector.
 		motion c;
-		m.p = mv_penalty(bx, by, m.dx = t.dx, m.dy = t.dy);
+		m.p = mv_penalty(bx, by, m.dx = t.dx, m.dy = t.dy, std::numeric_limits<uint32_t>::max());
 		if(!m.p)
 			return;
 		//Try the zero vector.
-		c.p = mv_penalty(bx, by, c.dx = 0, c.dy = 0);
+		c.p = mv_penalty(bx, by, c.dx = 0, c.dy = 0, m.p);
 		if(update_best(m, c))
 			return;
 		//Try cardinal vectors up to 9 units.
 		for(int s = 1; s < 10; s++) {
 			if(s == 0)
 				continue;
-			c.p = mv_penalty(bx, by, c.dx = -s, c.dy = 0);
+			c.p = mv_penalty(bx, by, c.dx = -s, c.dy = 0, m.p);
 			if(update_best(m, c))
 				return;
-			c.p = mv_penalty(bx, by, c.dx = 0, c.dy = -s);
+			c.p = mv_penalty(bx, by, c.dx = 0, c.dy = -s, m.p);
 			if(update_best(m, c))
 				return;
-			c.p = mv_penalty(bx, by, c.dx = s, c.dy = 0);
+			c.p = mv_penalty(bx, by, c.dx = s, c.dy = 0, m.p);
 			if(update_best(m, c))
 				return;
-			c.p = mv_penalty(bx, by, c.dx = 0, c.dy = s);
+			c.p = mv_penalty(bx, by, c.dx = 0, c.dy = s, m.p);
 			if(update_best(m, c))
 				return;
 		}
@@ -226,15 +396,35 @@ compress:
 		if(fullsearch)
 			for(int dy = -16; dy <= 16; dy++) {
 				for(int dx = -16; dx <= 16; dx++) {
-					c.p = mv_penalty(bx, by, c.dx = dx, c.dy = dy);
+					c.p = mv_penalty(bx, by, c.dx = dx, c.dy = dy, m.p);
 					if(update_best(m, c))
 						return;
 				}
 			}
 	}
 
+	void avi_codec_zmbv::mv_detect_rows(uint32_t first, uint32_t step)
+	{
+		uint32_t nhb = (ewidth + bw - 1) / bw;
+		uint32_t nvb = (eheight + bh - 1) / bh;
+		for(uint32_t y = first; y < nvb; y += step) {
+			//Rows are searched in parallel, so start each row from the vector its first block had in the
+			//previous frame.
+			motion t = mv[y * nhb];
+			for(uint32_t x = 0; x < nhb; x++) {
+				size_t i = y * nhb + x;
+				mv_detect(x * bw + MAXIMUM_VECTOR, y * bh + MAXIMUM_VECTOR, mv[i], t);
+				t = mv[i];
+			}
+		}
+	}
+
 	avi_codec_zmbv::~avi_codec_zmbv()
 	{
+		for(auto i : workers)
+			i->request_quit();
+		for(auto i : workers)
+			delete i;
 	}
 
 	unsigned getzlevel(uint32_t _level)
@@ -245,13 +435,26 @@ compress:
 	}
 
 	avi_codec_zmbv::avi_codec_zmbv(uint32_t _level, uint32_t maxpframes, uint32_t _bw, uint32_t _bh,
-		bool _fullsearch)
+		bool _fullsearch, uint32_t _threads)
 		: z(getzlevel(_level))
 	{
 		bh = _bh;
 		bw = _bw;
 		max_pframes = maxpframes;
 		fullsearch = _fullsearch;
+		xor_nonzero = select_xor_nonzero();
+		if(!_threads)
+			_threads = max(threads::hardware_concurrency(), 1U);
+		try {
+			for(uint32_t i = 1; i < _threads; i++)
+				workers.push_back(new zmbv_mv_worker(*this, i, _threads));
+		} catch(...) {
+			for(auto i : workers) {
+				i->request_quit();
+				delete i;
+			}
+			throw;
+		}
 	}
 
 	avi_video_codec::format avi_codec_zmbv::reset(uint32_t width, uint32_t height, uint32_t fps_n, uint32_t fps_d)
@@ -264,11 +467,15 @@ compress:
 		ready_flag = true;
 		avi_video_codec::format fmt(ewidth, eheight, 0x56424D5A, 24);
 
-		pixbuf.resize(2 * (ewidth + 2 * MAXIMUM_VECTOR) * (eheight + 2 * MAXIMUM_VECTOR) + bw * bh);
+		pixbuf.resize(2 * (ewidth + 2 * MAXIMUM_VECTOR) * (eheight + 2 * MAXIMUM_VECTOR));
 		current_frame = &pixbuf[0];
 		prev_frame = &pixbuf[(ewidth + 2 * MAXIMUM_VECTOR) * (eheight + 2 * MAXIMUM_VECTOR)];
-		scratch = &pixbuf[2 * (ewidth + 2 * MAXIMUM_VECTOR) * (eheight + 2 * MAXIMUM_VECTOR)];
 		mv.resize(((ewidth + bw - 1) / bw) * ((eheight + bh - 1) / bh));
+		for(auto& i : mv) {
+			i.dx = 0;
+			i.dy = 0;
+			i.p = 0;
+		}
 		outbuffer.resize(4 * ((mv.size() + 1) / 2) + 4 * ewidth * eheight);
 		oscratch = &outbuffer[0];
 		memset(&pixbuf[0], 0, 4 * pixbuf.size());
@@ -315,16 +522,12 @@ compress:
 			}
 
 		//Estimate motion vectors for all blocks if non-keyframe.
-		uint32_t nhb = (ewidth + bw - 1) / bw;
 		if(!keyframe) {
-			motion t;
-			t.dx = 0;
-			t.dy = 0;
-			t.p = 0;
-			for(size_t i = 0; i < mv.size(); i++) {
-				mv_detect((i % nhb) * bw + MAXIMUM_VECTOR, (i / nhb) * bh + MAXIMUM_VECTOR, mv[i], t);
-				t = mv[i];
-			}
+			for(auto i : workers)
+				i->start();
+			mv_detect_rows(0, workers.size() + 1);
+			for(auto i : workers)
+				i->wait_busy();
 		}
 
 		//Serialize and output.
@@ -352,6 +555,7 @@ compress:
 	avi_video_codec_type rgb("zmbv", "Zip Motion Blocks Video codec",
 		[]() -> avi_video_codec* {
 			return new avi_codec_zmbv(clvl(*CORE().settings), kint(*CORE().settings),
-				bwv(*CORE().settings), bhv(*CORE().settings), fsrch(*CORE().settings));
+				bwv(*CORE().settings), bhv(*CORE().settings), fsrch(*CORE().settings),
+				mvthreads(*CORE().settings));
 		});
 }
@@ -18,6 +18,11 @@ std::deque<frame_object>& avi_writer::video_queue()
 	return vqueue;
 }
 
+void avi_writer::set_frame_release(std::function<void(frame_object& f)> fn)
+{
+	frame_release = fn;
+}
+
 sample_queue& avi_writer::audio_queue()
 {
 	return aqueue;
@@ -79,10 +84,11 @@ do_again:
 			<< " to '" << aviname << "'" << std::endl;
 	}
 	uint64_t t = framerate_regulator::get_utime();
-	if(aviout.readqueue(f.data, f.odata, f.stride, aqueue, force)) {
+	if(aviout.readqueue(f.data, f.stride, aqueue, force)) {
 		t = framerate_regulator::get_utime() - t;
 		if(t > 20000)
 			std::cerr << "aviout.readqueue took " << t << std::endl;
+		frame_release(f);
 		vqueue.pop_front();
 		goto do_again;
 	}
@@ -98,4 +104,5 @@ avi_writer::avi_writer(const std::string& _prefix, struct avi_video_codec& _vcod
 	samplerate = _samplerate;
 	channels = _audiochannels;
 	curwidth = curheight = curfps_n = curfps_d = 0;
+	frame_release = [](frame_object& f) -> void { delete[] f.odata; };
 }
@@ -6,6 +6,7 @@
 #include "core/messages.hpp"
 #include "library/serialization.hpp"
 #include "library/minmax.hpp"
+#include "library/workthread.hpp"
 #include "video/tcp.hpp"
 
 #include <iomanip>
@@ -23,12 +24,187 @@ namespace
 {
 	settingvar::supervariable<settingvar::model_int<0,9>> clevel(lsnes_setgrp, "jmd-compression",
 		"JMD‣Compression", 7);
+	settingvar::supervariable<settingvar::model_int<0,64>> cthreads(lsnes_setgrp, "jmd-threads",
+		"JMD‣Compression threads (0 = auto)", 0);
 
 	void deleter_fn(void* f)
 	{
 		delete reinterpret_cast<std::ofstream*>(f);
 	}
 
+	void compact_buffer(uint8_t* buf, size_t p, size_t s, size_t w, size_t& c)
+	{
+		size_t x = p % s;
+		size_t y = p / s;
+		size_t sptr = 0;
+		size_t dptr = 0;
+		size_t left = c;
+		while(left > 0) {
+			if(x < w) {
+				//Something to copy.
+				size_t px = min(w - x, left);
+				memmove(buf + dptr, buf + sptr, 4 * px);
+				x += px;
+				sptr += 4 * px;
+				dptr += 4 * px;
+				left -= px;
+			} else {
+				//In postgap.
+				size_t px = min(s - x, left);
+				x += px;
+				sptr += 4 * px;
+				left -= px;
+				if(x == s) {
+					x = 0;
+					y++;
+				}
+			}
+		}
+		c = dptr / 4;
+	}
+
+	std::vector<char> compress_frame(uint32_t* memory, uint32_t stride, uint32_t width, uint32_t height,
+		unsigned complevel)
+	{
+		std::vector<char> ret;
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		if(deflateInit(&stream, complevel) != Z_OK)
+			throw std::runtime_error("Can't initialize zlib stream");
+
+		size_t usize = 4;
+		ret.resize(4);
+		serialization::u16b(&ret[0], width);
+		serialization::u16b(&ret[2], height);
+		uint8_t input_buffer[4 * INBUF_PIXELS] __attribute__((aligned(16)));
+		size_t ptr = 0;
+		size_t pixels = static_cast<size_t>(stride) * height;
+		bool input_clear = true;
+		bool flushed = false;
+		size_t bsize = 0;
+		while(1) {
+			if(input_clear) {
+				size_t csize;
+				size_t pixel = ptr;
+				size_t pcount = min(static_cast<size_t>(INBUF_PIXELS), pixels - pixel);
+				framebuffer::copy_swap4(input_buffer, memory + pixel, pcount);
+				csize = pcount;
+				compact_buffer(input_buffer, pixel, stride, width, csize);
+				pixel += pcount;
+				bsize = csize;
+				ptr = pixel;
+				input_clear = false;
+				//Now the input data to compress is in input_buffer, bsize elements.
+				stream.next_in = reinterpret_cast<uint8_t*>(input_buffer);
+				stream.avail_in = 4 * bsize;
+			}
+			if(!stream.avail_out) {
+				if(flushed)
+					usize += (OUTBUF_ADVANCE - stream.avail_out);
+				flushed = true;
+				ret.resize(usize + OUTBUF_ADVANCE);
+				stream.next_out = reinterpret_cast<uint8_t*>(&ret[usize]);
+				stream.avail_out = OUTBUF_ADVANCE;
+			}
+			int r = deflate(&stream, (ptr == pixels) ? Z_FINISH : 0);
+			if(r == Z_STREAM_END)
+				break;
+			if(r != Z_OK)
+				throw std::runtime_error("Can't deflate data");
+			if(!stream.avail_in)
+				input_clear = true;
+		}
+		usize += (OUTBUF_ADVANCE - stream.avail_out);
+		deflateEnd(&stream);
+
+		ret.resize(usize);
+		return ret;
+	}
+
+	//Compresses frames in background.
+	struct jmd_compressor : public workthread
+	{
+		jmd_compressor(unsigned _complevel);
+		~jmd_compressor();
+		void entry();
+		void queue_frame(const framebuffer::fb<false>& frame, uint64_t ts);
+		bool collect(std::vector<char>& data, uint64_t& ts);
+	private:
+		unsigned complevel;
+		std::vector<uint32_t> raw;
+		uint32_t stride;
+		uint32_t width;
+		uint32_t height;
+		uint64_t frame_ts;
+		std::vector<char> output;
+		bool has_output;
+		std::string error;
+	};
+
+#define WORKFLAG_QUEUE_FRAME 1
+
+	jmd_compressor::jmd_compressor(unsigned _complevel)
+	{
+		complevel = _complevel;
+		has_output = false;
+		fire();
+	}
+
+	jmd_compressor::~jmd_compressor()
+	{
+	}
+
+	void jmd_compressor::queue_frame(const framebuffer::fb<false>& frame, uint64_t ts)
+	{
+		rethrow();
+		wait_busy();
+		stride = frame.get_stride();
+		width = frame.get_width();
+		height = frame.get_height();
+		raw.resize(static_cast<size_t>(stride) * height);
+		if(raw.size())
+			memcpy(&raw[0], frame.rowptr(0), raw.size() * sizeof(uint32_t));
+		frame_ts = ts;
+		set_busy();
+		set_workflag(WORKFLAG_QUEUE_FRAME);
+	}
+
+	bool jmd_compressor::collect(std::vector<char>& data, uint64_t& ts)
+	{
+		wait_busy();
+		rethrow();
+		if(error != "")
+			throw std::runtime_error(error);
+		if(!has_output)
+			return false;
+		std::swap(data, output);
+		ts = frame_ts;
+		has_output = false;
+		return true;
+	}
+
+	void jmd_compressor::entry()
+	{
+		while(1) {
+			wait_workflag();
+			uint32_t work = clear_workflag(~workthread::quit_request);
+			if(work & WORKFLAG_QUEUE_FRAME) {
+				//Report errors on collect, the emulator thread is waiting for this.
+				try {
+					output = compress_frame(raw.size() ? &raw[0] : NULL, stride, width, height,
+						complevel);
+					has_output = true;
+				} catch(std::exception& e) {
+					error = e.what();
+				}
+				clear_workflag(WORKFLAG_QUEUE_FRAME);
+				clear_busy();
+			}
+			if(work == workthread::quit_request)
+				break;
+		}
+	}
+
 	class jmd_dump_obj : public dumper_base
 	{
 	public:
@@ -40,7 +216,10 @@ namespace
 			if(prefix == "")
 				throw std::runtime_error("Expected target");
 			try {
-			complevel = clevel(*core.settings);
+				unsigned complevel = clevel(*core.settings);
+				unsigned threadcount = cthreads(*core.settings);
+				if(!threadcount)
+					threadcount = max(threads::hardware_concurrency(), 1U);
 				if(mode == "tcp") {
 					jmd = &(socket_address(prefix).connect());
 					deleter = socket_address::deleter();
@@ -81,15 +260,21 @@ namespace
 				video_n = 0;
 				maxtc = 0;
 				soundrate = mdumper.get_rate();
+				next_compressor = 0;
+				for(unsigned i = 0; i < threadcount; i++)
+					compressors.push_back(new jmd_compressor(complevel));
 				mdumper.add_dumper(*this);
 			} catch(std::bad_alloc& e) {
+				delete_compressors();
 				throw;
 			} catch(std::exception& e) {
+				delete_compressors();
 				std::ostringstream x;
 				x << "Error starting JMD dump: " << e.what();
 				throw std::runtime_error(x.str());
 			}
-			messages << "Dumping to " << prefix << " at level " << clevel(*core.settings) << std::endl;
+			messages << "Dumping to " << prefix << " at level " << clevel(*core.settings) << " ("
+				<< compressors.size() << " threads)" << std::endl;
 		}
 		~jmd_dump_obj() throw()
 		{
@@ -98,6 +283,13 @@ namespace
 				char dummypacket[8] = {0x00, 0x03};
 				if(!jmd)
 					goto out;
+				try {
+					collect_frames(compressors.size());
+				} catch(...) {
+					delete_compressors();
+					throw;
+				}
+				delete_compressors();
 				flush_buffers(true);
 				if(last_written_ts > maxtc) {
 					deleter(jmd);
@@ -122,14 +314,14 @@ out:
 
 		void on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
 		{
-			if(!render_video_hud(dscr, _frame, fps_n, fps_d, 1, 1, 0, 0, 0, 0, NULL))
+			auto f = render_video_hud_shared(dscr, _frame, fps_n, fps_d, 1, 1, 0, 0, 0, 0, NULL);
+			if(!f)
 				return;
-			frame_buffer f;
-			f.ts = get_next_video_ts(fps_n, fps_d);
-			//We'll compress the frame here.
-			f.data = compress_frame(dscr.rowptr(0), dscr.get_stride(), dscr.get_width(),
-				dscr.get_height());
-			frames.push_back(f);
+			//Frames are compressed by the compressors in turn, so collecting the results in the same order
+			//keeps the frames in timestamp order.
+			collect_frames(1);
+			compressors[next_compressor]->queue_frame(*f, get_next_video_ts(fps_n, fps_d));
+			next_compressor = (next_compressor + 1) % compressors.size();
 			flush_buffers(false);
 			have_dumped_frame = true;
 		}
@@ -146,6 +338,21 @@ out:
 				flush_buffers(false);
 			}
 		}
+		void on_samples(const int16_t* data, size_t count, bool stereo)
+		{
+			for(size_t i = 0; i < count; i++) {
+				uint64_t ts = get_next_audio_ts();
+				if(have_dumped_frame) {
+					sample_buffer s;
+					s.ts = ts;
+					s.l = stereo ? data[2 * i + 0] : data[i];
+					s.r = stereo ? data[2 * i + 1] : data[i];
+					samples.push_back(s);
+				}
+			}
+			if(have_dumped_frame)
+				flush_buffers(false);
+		}
 		void on_rate_change(uint32_t n, uint32_t d)
 		{
 			soundrate = std::make_pair(n, d);
@@ -209,93 +416,26 @@ out:
 
 		std::deque<frame_buffer> frames;
 		std::deque<sample_buffer> samples;
+		std::vector<jmd_compressor*> compressors;
+		size_t next_compressor;
 
-		void compact_buffer(uint8_t* buf, size_t p, size_t s, size_t w, size_t& c)
+		void collect_frames(size_t count)
 		{
-			size_t x = p % s;
-			size_t y = p / s;
-			size_t sptr = 0;
-			size_t dptr = 0;
-			size_t left = c;
-			while(left > 0) {
-				if(x < w) {
-					//Something to copy.
-					size_t px = min(w - x, left);
-					memmove(buf + dptr, buf + sptr, 4 * px);
-					x += px;
-					sptr += 4 * px;
-					dptr += 4 * px;
-					left -= px;
-				} else {
-					//In postgap.
-					size_t px = min(s - x, left);
-					x += px;
-					sptr += 4 * px;
-					left -= px;
-					if(x == s) {
-						x = 0;
-						y++;
-					}
-				}
+			for(size_t i = 0; i < count; i++) {
+				frame_buffer f;
+				size_t c = (next_compressor + i) % compressors.size();
+				if(compressors[c]->collect(f.data, f.ts))
+					frames.push_back(f);
 			}
-			c = dptr / 4;
 		}
 
-		std::vector<char> compress_frame(uint32_t* memory, uint32_t stride, uint32_t width, uint32_t height)
+		void delete_compressors()
 		{
-			std::vector<char> ret;
-			z_stream stream;
-			memset(&stream, 0, sizeof(stream));
-			if(deflateInit(&stream, complevel) != Z_OK)
-				throw std::runtime_error("Can't initialize zlib stream");
-
-			size_t usize = 4;
-			ret.resize(4);
-			serialization::u16b(&ret[0], width);
-			serialization::u16b(&ret[2], height);
-			uint8_t input_buffer[4 * INBUF_PIXELS] __attribute__((aligned(16)));
-			size_t ptr = 0;
-			size_t pixels = static_cast<size_t>(stride) * height;
-			bool input_clear = true;
-			bool flushed = false;
-			size_t bsize = 0;
-			while(1) {
-				if(input_clear) {
-					size_t csize;
-					size_t pixel = ptr;
-					size_t pcount = min(static_cast<size_t>(INBUF_PIXELS), pixels - pixel);
-					framebuffer::copy_swap4(input_buffer, memory + pixel, pcount);
-					csize = pcount;
-					compact_buffer(input_buffer, pixel, stride, width, csize);
-					pixel += pcount;
-					bsize = csize;
-					ptr = pixel;
-					input_clear = false;
-					//Now the input data to compress is in input_buffer, bsize elements.
-					stream.next_in = reinterpret_cast<uint8_t*>(input_buffer);
-					stream.avail_in = 4 * bsize;
-				}
-				if(!stream.avail_out) {
-					if(flushed)
-						usize += (OUTBUF_ADVANCE - stream.avail_out);
-					flushed = true;
-					ret.resize(usize + OUTBUF_ADVANCE);
-					stream.next_out = reinterpret_cast<uint8_t*>(&ret[usize]);
-					stream.avail_out = OUTBUF_ADVANCE;
-				}
-				int r = deflate(&stream, (ptr == pixels) ? Z_FINISH : 0);
-				if(r == Z_STREAM_END)
-					break;
-				if(r != Z_OK)
-					throw std::runtime_error("Can't deflate data");
-				if(!stream.avail_in)
-					input_clear = true;
+			for(auto i : compressors) {
+				i->request_quit();
+				delete i;
 			}
-			usize += (OUTBUF_ADVANCE - stream.avail_out);
-			deflateEnd(&stream);
-
-			ret.resize(usize);
-			return ret;
+			compressors.clear();
 		}
 
 		void flush_buffers(bool force)
@@ -365,7 +505,6 @@ out:
 		std::ostream* jmd;
 		void (*deleter)(void* f);
 		uint64_t last_written_ts;
-		unsigned complevel;
 		master_dumper& mdumper;
 	};
 
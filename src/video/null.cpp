@@ -53,6 +53,10 @@ namespace
 		{
 			//Do nothing.
 		}
+		void on_samples(const int16_t* samples, size_t count, bool stereo)
+		{
+			//Do nothing.
+		}
 		void on_rate_change(uint32_t n, uint32_t d)
 		{
 			//Do nothing.
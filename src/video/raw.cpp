@@ -121,19 +121,20 @@ namespace
 					video->write(reinterpret_cast<char*>(&tmp[alignment]), 8 * w);
 				}
 			} else {
-				size_t w = dscr.get_width();
-				size_t h = dscr.get_height();
-				size_t s = dscr2.get_stride();
+				auto f = render_video_hud_shared(dscr, _frame, fps_n, fps_d, hscl, vscl, 0, 0, 0, 0, NULL);
+				if(!f)
+					return;
+				size_t w = f->get_width();
+				size_t h = f->get_height();
+				size_t s = f->get_stride();
 				std::vector<uint8_t> tmp;
 				tmp.resize(4 * s + 16);
 				uint32_t alignment = (16 - reinterpret_cast<size_t>(&tmp[0])) % 16;
-				if(!render_video_hud(dscr, _frame, fps_n, fps_d, hscl, vscl, 0, 0, 0, 0, NULL))
-					return;
 				for(size_t i = 0; i < h; i++) {
 					if(!swap)
-						framebuffer::copy_swap4(&tmp[alignment], dscr.rowptr(i), s);
+						framebuffer::copy_swap4(&tmp[alignment], f->rowptr(i), s);
 					else
-						memcpy(&tmp[alignment], dscr.rowptr(i), 4 * w);
+						memcpy(&tmp[alignment], f->rowptr(i), 4 * w);
 					video->write(reinterpret_cast<char*>(&tmp[alignment]), 4 * w);
 				}
 			}
@@ -151,6 +152,18 @@ namespace
 				audio->write(buffer, 4);
 			}
 		}
+		void on_samples(const int16_t* samples, size_t count, bool stereo)
+		{
+			if(have_dumped_frame && audio) {
+				abuffer.resize(4 * count);
+				for(size_t i = 0; i < count; i++) {
+					serialization::s16b(&abuffer[4 * i + 0], stereo ? samples[2 * i + 0] : samples[i]);
+					serialization::s16b(&abuffer[4 * i + 2], stereo ? samples[2 * i + 1] : samples[i]);
+				}
+				if(count)
+					audio->write(&abuffer[0], abuffer.size());
+			}
+		}
 		void on_rate_change(uint32_t n, uint32_t d)
 		{
 			//Do nothing.
@@ -168,6 +181,7 @@ namespace
 		std::ostream* video;
 		void (*deleter)(void* f);
 		bool have_dumped_frame;
+		std::vector<char> abuffer;
 		struct framebuffer::fb<false> dscr;
 		struct framebuffer::fb<true> dscr2;
 		bool swap;
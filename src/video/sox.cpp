@@ -1,6 +1,7 @@
 #include "video/sox.hpp"
 #include "library/serialization.hpp"
 
+#include <cstring>
 #include <iostream>
 
 namespace
@@ -79,3 +80,25 @@ void sox_dumper::internal_dump_sample()
 		throw std::runtime_error("Failed to dump sample");
 	samples_dumped++;
 }
+
+void sox_dumper::samples(const int16_t* samples, size_t count, bool stereo)
+{
+	if(!count)
+		return;
+	size_t chans = samplebuffer.size();
+	blockbuf.resize(4 * chans * count);
+	memset(&blockbuf[0], 0, blockbuf.size());
+	for(size_t i = 0; i < count; i++) {
+		int16_t l = stereo ? samples[2 * i + 0] : samples[i];
+		int16_t r = stereo ? samples[2 * i + 1] : samples[i];
+		char* out = &blockbuf[4 * chans * i];
+		if(chans > 0)
+			serialization::u32l(out + 0, static_cast<uint32_t>(static_cast<int32_t>(l) << 16));
+		if(chans > 1)
+			serialization::u32l(out + 4, static_cast<uint32_t>(static_cast<int32_t>(r) << 16));
+	}
+	sox_file.write(&blockbuf[0], blockbuf.size());
+	if(!sox_file)
+		throw std::runtime_error("Failed to dump sample");
+	samples_dumped += count;
+}